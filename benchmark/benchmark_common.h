@@ -0,0 +1,100 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// benchmark_common.h
+// Helpers shared by the offline benchmarks.
+
+#ifndef ROBOT_STATE_PUBLISHER_BENCHMARK_COMMON_H_
+#define ROBOT_STATE_PUBLISHER_BENCHMARK_COMMON_H_
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace robot_state_publisher_benchmark {
+
+// Read one of the URDF files in the test directory.
+inline std::string loadTestUrdf(const std::string & fileName)
+{
+  std::ifstream file((std::string(TEST_DATA_DIR) + "/" + fileName).c_str());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Build a synthetic tree of `links` links, each with up to `branching` children.
+// Every fifth joint is fixed and every seventh mimics its parent joint; the
+// rest are continuous, alternating between the z and y axes.
+inline std::string makeSyntheticUrdf(unsigned int links, unsigned int branching)
+{
+  std::ostringstream urdf;
+  urdf << "<robot name=\"synthetic\">\n  <link name=\"link0\"/>\n";
+  for (unsigned int i = 1; i < links; ++i)
+  {
+    unsigned int parent = (i - 1) / branching;
+    bool fixed = (i % 5 == 0);
+    bool mimic = !fixed && (i % 7 == 0) && parent != 0 && (parent % 5 != 0);
+    urdf << "  <link name=\"link" << i << "\"/>\n"
+         << "  <joint name=\"joint" << i << "\" type=\"" << (fixed ? "fixed" : "continuous") << "\">\n"
+         << "    <parent link=\"link" << parent << "\"/>\n"
+         << "    <child link=\"link" << i << "\"/>\n"
+         << "    <origin xyz=\"0.1 0 0.05\" rpy=\"0 0 0.3\"/>\n";
+    if (!fixed)
+    {
+      urdf << "    <axis xyz=\"" << (i % 2 ? "0 0 1" : "0 1 0") << "\"/>\n";
+    }
+    if (mimic)
+    {
+      urdf << "    <mimic joint=\"joint" << parent << "\" multiplier=\"0.5\" offset=\"0.1\"/>\n";
+    }
+    urdf << "  </joint>\n";
+  }
+  urdf << "</robot>\n";
+  return urdf.str();
+}
+
+// The robots the per-model benchmarks run over, selected by index.
+static const int TEST_MODEL_COUNT = 6;
+
+inline std::string loadTestModel(int index, std::string & name)
+{
+  switch (index)
+  {
+    case 0:  name = "one_link";                 return loadTestUrdf("one_link.urdf");
+    case 1:  name = "two_links_fixed_joint";    return loadTestUrdf("two_links_fixed_joint.urdf");
+    case 2:  name = "two_links_moving_joint";   return loadTestUrdf("two_links_moving_joint.urdf");
+    case 3:  name = "pr2";                      return loadTestUrdf("pr2.urdf");
+    case 4:  name = "synthetic_100";            return makeSyntheticUrdf(100, 2);
+    default: name = "synthetic_1000";           return makeSyntheticUrdf(1000, 3);
+  }
+}
+
+}  // namespace robot_state_publisher_benchmark
+
+#endif /* ROBOT_STATE_PUBLISHER_BENCHMARK_COMMON_H_ */
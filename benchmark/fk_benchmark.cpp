@@ -0,0 +1,238 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// fk_benchmark.cpp
+// Forward kinematics of pr2.urdf over a batch of joint configurations: the
+// recursive solver called once per configuration against one batched call,
+// and the per-joint poses and transforms through KDL against the precompiled
+// pose kernels.
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <kdl_parser/kdl_parser.hpp>
+#include <tf2_kdl/tf2_kdl.h>
+
+#include "robot_state_publisher/treefksolverposfull_flat.hpp"
+#include "robot_state_publisher/treefksolverposfull_recursive.hpp"
+#include "robot_state_publisher/pose_kernel.h"
+#include "benchmark_common.h"
+
+namespace robot_state_publisher_benchmark {
+
+static bool loadPr2Tree(KDL::Tree & tree)
+{
+  return kdl_parser::treeFromString(loadTestUrdf("pr2.urdf"), tree);
+}
+
+static void randomize(KDL::TreeFkSolverPosFull_flat::BatchArray & q)
+{
+  std::srand(1);
+  for (Eigen::Index c = 0; c < q.rows(); ++c)
+  {
+    for (Eigen::Index j = 0; j < q.cols(); ++j)
+    {
+      q(c, j) = 6.0 * std::rand() / RAND_MAX - 3.0;
+    }
+  }
+}
+
+static void BM_FkRecursive(benchmark::State & state)
+{
+  KDL::Tree tree;
+  if (!loadPr2Tree(tree))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  KDL::TreeFkSolverPosFull_recursive solver(tree);
+  KDL::TreeFkSolverPosFull_flat flat(tree);
+  const std::vector<std::string> & joints = flat.getJointNames();
+
+  KDL::TreeFkSolverPosFull_flat::BatchArray q(state.range(0), joints.size());
+  randomize(q);
+  std::vector<std::map<std::string, double> > configs(q.rows());
+  for (Eigen::Index c = 0; c < q.rows(); ++c)
+  {
+    for (size_t j = 0; j < joints.size(); ++j)
+    {
+      configs[c][joints[j]] = q(c, j);
+    }
+  }
+
+  std::map<std::string, tf2::Stamped<KDL::Frame> > poses;
+  for (auto _ : state)
+  {
+    for (size_t c = 0; c < configs.size(); ++c)
+    {
+      solver.JntToCart(configs[c], poses);
+      benchmark::DoNotOptimize(poses);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FkRecursive)->RangeMultiplier(8)->Range(1, 512);
+
+static void BM_FkBatch(benchmark::State & state)
+{
+  KDL::Tree tree;
+  if (!loadPr2Tree(tree))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  KDL::TreeFkSolverPosFull_flat solver(tree);
+
+  KDL::TreeFkSolverPosFull_flat::BatchArray q(state.range(0), solver.getNrOfJoints()), poses;
+  randomize(q);
+  for (auto _ : state)
+  {
+    solver.JntToCartBatch(q, poses);
+    benchmark::DoNotOptimize(poses.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FkBatch)->RangeMultiplier(8)->Range(1, 512);
+
+// Every moving segment of pr2.urdf
+static bool loadPr2Segments(std::vector<KDL::Segment> & segments)
+{
+  KDL::Tree tree;
+  if (!loadPr2Tree(tree))
+  {
+    return false;
+  }
+  const KDL::SegmentMap & map = tree.getSegments();
+  for (KDL::SegmentMap::const_iterator s = map.begin(); s != map.end(); ++s)
+  {
+    const KDL::Segment & segment = GetTreeElementSegment(s->second);
+    if (segment.getJoint().getType() != KDL::Joint::None)
+    {
+      segments.push_back(segment);
+    }
+  }
+  return true;
+}
+
+static void BM_SegmentPose(benchmark::State & state)
+{
+  std::vector<KDL::Segment> segments;
+  if (!loadPr2Segments(segments))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  double q = 0.1;
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+      KDL::Frame pose = segments[i].pose(q);
+      benchmark::DoNotOptimize(pose);
+    }
+    q += 1e-3;
+  }
+  state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(BM_SegmentPose);
+
+static void BM_KernelPose(benchmark::State & state)
+{
+  std::vector<KDL::Segment> segments;
+  if (!loadPr2Segments(segments))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  std::vector<robot_state_publisher::PoseKernel> kernels(segments.begin(), segments.end());
+  double q = 0.1;
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+      KDL::Frame pose = kernels[i].pose(segments[i], q);
+      benchmark::DoNotOptimize(pose);
+    }
+    q += 1e-3;
+  }
+  state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(BM_KernelPose);
+
+static void BM_SegmentTransform(benchmark::State & state)
+{
+  std::vector<KDL::Segment> segments;
+  if (!loadPr2Segments(segments))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  geometry_msgs::Transform transform;
+  double q = 0.1;
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+      transform = tf2::kdlToTransform(segments[i].pose(q)).transform;
+      benchmark::DoNotOptimize(transform);
+    }
+    q += 1e-3;
+  }
+  state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(BM_SegmentTransform);
+
+static void BM_KernelTransform(benchmark::State & state)
+{
+  std::vector<KDL::Segment> segments;
+  if (!loadPr2Segments(segments))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  std::vector<robot_state_publisher::PoseKernel> kernels(segments.begin(), segments.end());
+  geometry_msgs::Transform transform;
+  double q = 0.1;
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+      kernels[i].transform(segments[i], q, transform);
+      benchmark::DoNotOptimize(transform);
+    }
+    q += 1e-3;
+  }
+  state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(BM_KernelTransform);
+
+}  // namespace robot_state_publisher_benchmark
@@ -0,0 +1,361 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// publish_benchmark.cpp
+// The joint state to tf hot path, fixed transforms, mimic joints, tree FK,
+// URDF regeneration, assembly and tool changes, over the test robots and
+// synthetic trees.
+// The broadcasters are stubbed out, so no roscore is needed.
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <kdl_parser/kdl_parser.hpp>
+#include <intera_core_msgs/URDFConfiguration.h>
+#include <sensor_msgs/JointState.h>
+
+#include "robot_state_publisher/joint_state_listener.h"
+#include "robot_state_publisher/robot_state_publisher.h"
+#include "robot_state_publisher/treefksolverposfull_recursive.hpp"
+#include "benchmark_common.h"
+
+namespace robot_state_publisher_benchmark {
+
+class BenchmarkRobotStatePublisher : public robot_state_publisher::RobotStatePublisher
+{
+ public:
+  BenchmarkRobotStatePublisher() : batches_(0) {}
+
+  // Regenerate the background URDF and build a KDL tree from it, as a full
+  // (non-incremental) URDF change does.
+  bool regenerate(KDL::Tree & tree)
+  {
+    return regenerateUrdf() && kdl_parser::treeFromUrdfModel(*getUrdfBgPtr(), tree);
+  }
+
+  // Attach `count` small fragments, each adding one link below base_link.
+  void addFragments(int count)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      std::ostringstream name;
+      name << "fragment_" << i;
+      URDFFragment & fragment = m_urdfMap[makeKey("base_link", name.str() + "_joint")];
+      fragment.parentLink = "base_link";
+      fragment.jointName = name.str() + "_joint";
+      fragment.xml = "<link name=\"" + name.str() + "\"/>"
+                     "<joint name=\"" + name.str() + "_joint\" type=\"fixed\">"
+                     "<parent link=\"base_link\"/><child link=\"" + name.str() + "\"/></joint>";
+      fragment.timestamp = 1.0;
+      fragment.grafted = false;
+    }
+  }
+
+  // Attach a tool below base_link, as a URDFConfiguration message would.
+  void configureTool(const std::string & tool, double time)
+  {
+    intera_core_msgs::URDFConfiguration config;
+    config.link = "base_link";
+    config.joint = "tool_joint";
+    config.time = ros::Time(time);
+    config.urdf = "<robot name=\"tool\"><link name=\"" + tool + "\"/>"
+                  "<joint name=\"tool_joint\" type=\"fixed\">"
+                  "<parent link=\"base_link\"/><child link=\"" + tool + "\"/></joint></robot>";
+    onURDFConfigurationMsg(config);
+  }
+
+  // Assemble the document from the base and the fragments; the size of the result.
+  size_t assemble()
+  {
+    assembleUrdfDoc();
+    return m_urdfDoc->size();
+  }
+
+  unsigned int batches_;
+
+ protected:
+  virtual void sendTransforms(const tf2_msgs::TFMessage& message, bool use_tf_static)
+  {
+    (void)use_tf_static;
+    ++batches_;
+    benchmark::DoNotOptimize(message.transforms.data());
+  }
+};
+typedef boost::shared_ptr<BenchmarkRobotStatePublisher> BenchmarkRobotStatePublisherPtr;
+
+class BenchmarkJointStateListener : public robot_state_publisher::JointStateListener
+{
+ public:
+  BenchmarkJointStateListener(const robot_state_publisher::RobotStatePublisherPtr& state_publisher) :
+    robot_state_publisher::JointStateListener(state_publisher)
+  {
+  }
+
+  void callback(const JointStateConstPtr& state)
+  {
+    callbackJointState(state);
+  }
+};
+
+// Load the model selected by the benchmark argument; false if the benchmark should stop.
+static bool loadPublisher(benchmark::State & state, BenchmarkRobotStatePublisherPtr & publisher)
+{
+  std::string name;
+  const std::string urdf = loadTestModel(state.range(0), name);
+  state.SetLabel(name);
+  publisher.reset(new BenchmarkRobotStatePublisher());
+  if (!publisher->initFromString(urdf))
+  {
+    state.SkipWithError(("could not load " + name).c_str());
+    return false;
+  }
+  return true;
+}
+
+// Positions for every moving joint that is not a mimic joint.
+static void makeJointState(const urdf::Model & model, sensor_msgs::JointState & js)
+{
+  for (std::map<std::string, urdf::JointSharedPtr>::const_iterator i = model.joints_.begin(); i != model.joints_.end(); ++i)
+  {
+    if (i->second->type != urdf::Joint::FIXED && i->second->type != urdf::Joint::FLOATING && !i->second->mimic)
+    {
+      js.name.push_back(i->first);
+      js.position.push_back(0.1 * js.name.size());
+    }
+  }
+}
+
+static void BM_CallbackJointState(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+  BenchmarkJointStateListener listener(publisher);
+
+  sensor_msgs::JointState::Ptr js(new sensor_msgs::JointState);
+  makeJointState(*publisher->getUrdfPtr(), *js);
+  JointStateConstPtr message(js);
+
+  // every message is newer than the publish interval, so every one is published
+  js->header.stamp = ros::Time::now();
+  for (auto _ : state)
+  {
+    js->header.stamp += ros::Duration(1.0);
+    listener.callback(message);
+  }
+  state.counters["joints"] = js->name.size();
+}
+BENCHMARK(BM_CallbackJointState)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_PublishTransforms(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher->getSnapshot();
+  std::vector<double> positions(snapshot->joint_segments.size(), 0.1);
+  std::vector<char> valid(snapshot->joint_segments.size(), 1);
+  ros::Time stamp = ros::Time::now();
+  for (auto _ : state)
+  {
+    publisher->publishTransforms(*snapshot, positions, valid, stamp);
+  }
+  state.counters["transforms"] = snapshot->joint_segments.size();
+}
+BENCHMARK(BM_PublishTransforms)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_PublishTransformsMap(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher->getSnapshot();
+  std::map<std::string, double> positions;
+  for (size_t i = 0; i < snapshot->joint_segments.size(); ++i)
+  {
+    positions[snapshot->joint_segments[i].segment.getJoint().getName()] = 0.1;
+  }
+  ros::Time stamp = ros::Time::now();
+  for (auto _ : state)
+  {
+    publisher->publishTransforms(positions, stamp);
+  }
+}
+BENCHMARK(BM_PublishTransformsMap)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_PublishFixedTransforms(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  for (auto _ : state)
+  {
+    publisher->publishFixedTransforms(true);
+  }
+  state.counters["transforms"] = publisher->getSnapshot()->fixed_transforms.size();
+}
+BENCHMARK(BM_PublishFixedTransforms)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_GetJointMimicPositions(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher->getSnapshot();
+  sensor_msgs::JointState js;
+  makeJointState(*publisher->getUrdfPtr(), js);
+  std::vector<double> positions;
+  std::vector<char> valid;
+  for (auto _ : state)
+  {
+    // mimic joints start out unset, as they do for every joint state message
+    positions.assign(snapshot->joint_segments.size(), 0.1);
+    valid.assign(snapshot->joint_segments.size(), 1);
+    for (robot_state_publisher::MimicMap::const_iterator i = snapshot->mimic.begin(); i != snapshot->mimic.end(); ++i)
+    {
+      int index = snapshot->getJointIndex(i->first);
+      if (index >= 0)  valid[index] = 0;
+    }
+    snapshot->getJointMimicPositions(positions, valid);
+    benchmark::DoNotOptimize(positions.data());
+  }
+  state.counters["mimic"] = snapshot->mimic.size();
+}
+BENCHMARK(BM_GetJointMimicPositions)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_JntToCart(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  KDL::TreeFkSolverPosFull_recursive solver(publisher->getTree());
+  std::map<std::string, double> positions;
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher->getSnapshot();
+  for (size_t i = 0; i < snapshot->joint_segments.size(); ++i)
+  {
+    positions[snapshot->joint_segments[i].segment.getJoint().getName()] = 0.1;
+  }
+  std::map<std::string, tf2::Stamped<KDL::Frame> > poses;
+  for (auto _ : state)
+  {
+    solver.JntToCart(positions, poses);
+    benchmark::DoNotOptimize(poses);
+  }
+}
+BENCHMARK(BM_JntToCart)->DenseRange(0, TEST_MODEL_COUNT - 1);
+
+static void BM_RegenerateUrdf(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher;
+  if (!loadPublisher(state, publisher))  return;
+
+  for (auto _ : state)
+  {
+    KDL::Tree tree;
+    if (!publisher->regenerate(tree))
+    {
+      state.SkipWithError("could not regenerate the URDF");
+      break;
+    }
+    benchmark::DoNotOptimize(tree);
+  }
+}
+BENCHMARK(BM_RegenerateUrdf)->DenseRange(0, TEST_MODEL_COUNT - 1)->Unit(benchmark::kMicrosecond);
+
+// Assembling the document should scale with its size, not with fragments times size.
+static void BM_AssembleUrdfDoc(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher(new BenchmarkRobotStatePublisher());
+  if (!publisher->initFromString(loadTestUrdf("pr2.urdf")))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+  publisher->addFragments(state.range(0));
+
+  size_t size = 0;
+  for (auto _ : state)
+  {
+    size = publisher->assemble();
+    benchmark::DoNotOptimize(size);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_AssembleUrdfDoc)->RangeMultiplier(4)->Range(1, 4096)->Complexity(benchmark::oN);
+
+// Alternating between two tools, with the model cache disabled (0) and enabled.
+static void BM_ToolChange(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher(new BenchmarkRobotStatePublisher());
+  publisher->setModelCacheSize(state.range(0));
+  if (!publisher->initFromString(loadTestUrdf("pr2.urdf")))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+
+  double time = 1.0;
+  for (auto _ : state)
+  {
+    publisher->configureTool(static_cast<int>(time) % 2 ? "gripper" : "suction_cup", time);
+    time += 1.0;
+  }
+  state.SetLabel(state.range(0) ? "cached" : "uncached");
+}
+BENCHMARK(BM_ToolChange)->Arg(0)->Arg(4)->Unit(benchmark::kMicrosecond);
+
+// A new tool on every change, so the cache never hits.  Disabled (0), the
+// change is replayed onto the previous foreground as without a cache; enabled,
+// every change first copies the cached model and tree.
+static void BM_ToolChangeMiss(benchmark::State & state)
+{
+  BenchmarkRobotStatePublisherPtr publisher(new BenchmarkRobotStatePublisher());
+  publisher->setModelCacheSize(state.range(0));
+  if (!publisher->initFromString(loadTestUrdf("pr2.urdf")))
+  {
+    state.SkipWithError("could not load pr2.urdf");
+    return;
+  }
+
+  double time = 1.0;
+  for (auto _ : state)
+  {
+    std::ostringstream tool;
+    tool << "tool_" << static_cast<int>(time);
+    publisher->configureTool(tool.str(), time);
+    time += 1.0;
+  }
+  state.SetLabel(state.range(0) ? "cached" : "uncached");
+}
+BENCHMARK(BM_ToolChangeMiss)->Arg(0)->Arg(4)->Unit(benchmark::kMicrosecond);
+
+}  // namespace robot_state_publisher_benchmark
@@ -0,0 +1,169 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// startup_benchmark.cpp
+// Time to load a URDF document into a RobotKDLTree, compared with the
+// sequence of parses the node used to run at startup.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/shared_ptr.hpp>
+#include <kdl_parser/kdl_parser.hpp>
+#include <urdf/model.h>
+
+#include "robot_state_publisher/kinematic_cache.h"
+#include "robot_state_publisher/robot_kdl_tree.h"
+#include "robot_state_publisher/robot_state_publisher.h"
+#include "benchmark_common.h"
+
+namespace robot_state_publisher_benchmark {
+
+class BenchmarkRobotKDLTree : public robot_kdl_tree::RobotKDLTree
+{
+ public:
+  BenchmarkRobotKDLTree() {}
+};
+
+// The former startup: main parsed the base description, RobotURDF parsed it
+// into both models and regenerated each of them, and RobotKDLTree built both trees.
+static void BM_StartupLegacy(benchmark::State & state)
+{
+  const std::string urdf = loadTestUrdf("pr2.urdf");
+  for (auto _ : state)
+  {
+    urdf::Model base, fg, bg;
+    base.initString(urdf);
+    fg.initString(urdf);
+    bg.initString(urdf);
+    bg.initString(urdf);
+    fg.initString(urdf);
+    KDL::Tree treeFg, treeBg;
+    kdl_parser::treeFromUrdfModel(bg, treeBg);
+    kdl_parser::treeFromUrdfModel(fg, treeFg);
+    benchmark::DoNotOptimize(treeFg);
+  }
+}
+BENCHMARK(BM_StartupLegacy)->Unit(benchmark::kMillisecond);
+
+// One parse and one tree build; the background copies are cloned.
+static void BM_Startup(benchmark::State & state)
+{
+  const std::string urdf = loadTestUrdf("pr2.urdf");
+  for (auto _ : state)
+  {
+    BenchmarkRobotKDLTree tree;
+    if (!tree.initFromString(urdf))
+    {
+      state.SkipWithError("could not load pr2.urdf");
+      break;
+    }
+    benchmark::DoNotOptimize(tree.getTree());
+  }
+}
+BENCHMARK(BM_Startup)->Unit(benchmark::kMillisecond);
+
+// Many robots from the same document, as in robot_state_publisher_host: only
+// the first one parses it, so the cost grows far slower than the robot count.
+static void BM_StartupRobots(benchmark::State & state)
+{
+  const std::string urdf = loadTestUrdf("pr2.urdf");
+  for (auto _ : state)
+  {
+    std::vector<boost::shared_ptr<BenchmarkRobotKDLTree> > robots;
+    for (int64_t i = 0; i < state.range(0); ++i)
+    {
+      robots.push_back(boost::shared_ptr<BenchmarkRobotKDLTree>(new BenchmarkRobotKDLTree()));
+      if (!robots.back()->initFromString(urdf))
+      {
+        state.SkipWithError("could not load pr2.urdf");
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(robots);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_StartupRobots)->RangeMultiplier(4)->Range(1, 64)->Complexity()->Unit(benchmark::kMillisecond);
+
+// Startup of a publisher with a kinematic cache: cold parses the URDF and
+// writes the cache, warm maps the cached snapshot and defers the parse.
+static void startupWithCache(benchmark::State & state, bool warm)
+{
+  const std::string urdf = loadTestUrdf("pr2.urdf");
+  char directory[] = "/tmp/robot_state_publisher_benchmark_XXXXXX";
+  if (!mkdtemp(directory))
+  {
+    state.SkipWithError("could not create the cache directory");
+    return;
+  }
+  uint64_t key = robot_state_publisher::KinematicCache::key(urdf, std::vector<std::string>(), "");
+  const std::string file = robot_state_publisher::KinematicCache::file(directory, key);
+  if (warm)
+  {
+    robot_state_publisher::RobotStatePublisher first;
+    first.setKinematicCache(directory);
+    first.initFromString(urdf);
+  }
+  for (auto _ : state)
+  {
+    if (!warm)
+    {
+      state.PauseTiming();
+      remove(file.c_str());
+      state.ResumeTiming();
+    }
+    robot_state_publisher::RobotStatePublisher publisher;
+    publisher.setKinematicCache(directory);
+    if (!publisher.initFromString(urdf))
+    {
+      state.SkipWithError("could not load pr2.urdf");
+      break;
+    }
+    benchmark::DoNotOptimize(publisher.getSnapshot());
+  }
+  remove(file.c_str());
+  remove(directory);
+}
+
+static void BM_StartupColdCache(benchmark::State & state)
+{
+  startupWithCache(state, false);
+}
+BENCHMARK(BM_StartupColdCache)->Unit(benchmark::kMillisecond);
+
+static void BM_StartupWarmCache(benchmark::State & state)
+{
+  startupWithCache(state, true);
+}
+BENCHMARK(BM_StartupWarmCache)->Unit(benchmark::kMillisecond);
+
+}  // namespace robot_state_publisher_benchmark
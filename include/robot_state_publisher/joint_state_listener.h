@@ -37,9 +37,15 @@
 #ifndef JOINT_STATE_LISTENER_H
 #define JOINT_STATE_LISTENER_H
 
+#include <atomic>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
 #include <urdf/model.h>
 #include <kdl/tree.hpp>
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <sensor_msgs/JointState.h>
 
 #include "robot_state_publisher/robot_state_publisher.h"
@@ -52,14 +58,40 @@ typedef boost::shared_ptr<sensor_msgs::JointState const> JointStateConstPtr;
 
 namespace robot_state_publisher {
 
+typedef boost::shared_ptr<RobotStatePublisher> RobotStatePublisherPtr;
+
 class JointStateListener {
 public:
+  /// Constructor; the robot description is loaded by init().
+  JointStateListener();
+
   /** Constructor
-   * \param tree The kinematic model of a robot, represented by a KDL Tree
+   * \param state_publisher The robot state publisher to feed, e.g. a subclass
+   *        overriding how transforms are sent.
+   */
+  JointStateListener(const RobotStatePublisherPtr& state_publisher);
+
+  /** Read the parameters, subscribe to joint states and start publishing.
+   * Until then the listener does not touch the ROS master.
    */
-  JointStateListener(const urdf::Model& model = urdf::Model());
   bool init();
 
+  /** Same as init(), with the node handles of a nodelet.
+   * \param n Node handle the joint states are subscribed on.
+   * \param n_private Node handle the parameters are read from.  Without
+   *        dedicated callback threads, URDF updates are served from its queue,
+   *        which must not run callbacks concurrently.
+   */
+  bool init(const ros::NodeHandle& n, const ros::NodeHandle& n_private);
+
+  /** Whether joint states, fixed joints and URDF updates get a spinner thread
+   * each, rather than being served from the queue of the node handles passed
+   * to init().  When enabled, the dedicated_callback_threads parameter may
+   * still disable them; when disabled, e.g. by a nodelet or a host serving the
+   * queues itself, the parameter is ignored.
+   */
+  void setDedicatedCallbackThreads(bool dedicated) { dedicated_callback_threads_ = dedicated; }
+
   /// Destructor
   ~JointStateListener();
 
@@ -68,19 +100,110 @@ protected:
   virtual void callbackFixedJoint(const ros::TimerEvent& e);
 
 private:
+  void setup(const ros::NodeHandle& n, const ros::NodeHandle& n_tilde);
   void callbackSaveUrdf(const ros::TimerEvent& e);
+  void callbackStats(const ros::TimerEvent& e);
+  bool applyDeadband(const KinematicSnapshot& snapshot, const ros::Time& stamp);
+  void resetJointTable(const KinematicSnapshot& snapshot);
+  void callbackSourceJointState(const JointStateConstPtr& state, size_t source);
+  void callbackAggregate(const ros::TimerEvent& e);
+  void callbackIngestJointState(const JointStateConstPtr& state);
+  void ingestDrainLoop();
+  void stopIngest();
+
+  // A joint name ordering received recently, resolved to joint table indices.
+  struct JointOrdering
+  {
+    size_t hash;                     // Of the names; compared before the names themselves
+    std::vector<std::string> names;
+    std::vector<int> indices;
+    ros::Time last_published;        // Least recent publish time over the joints of the ordering
+    uint64_t published;              // joint_ordering_publishes_ when last_published was brought up to date
+    uint64_t used;                   // For least recently used eviction
+    bool shared;                     // Shares joints with another cached ordering
+  };
+  JointOrdering& findJointOrdering(const KinematicSnapshot& snapshot, const std::vector<std::string>& names,
+                                   const ros::Time& now);
+
+  // A joint state topic merged by aggregation; see aggregate_sources.
+  struct JointStateSource
+  {
+    std::string topic;
+    ros::Duration max_age;     // Updates that waited longer for a batch are dropped
+    ros::Subscriber sub;
+    // Cache of the last joint name ordering from this source
+    std::vector<std::string> cached_joint_names;
+    std::vector<int> cached_joint_indices;
+    unsigned int cached_joint_table_version;
+  };
+
+  // Unless dedicated_callback_threads is false, joint states, fixed joints and
+  // URDF updates are each served by their own queue and spinner thread, so
+  // URDF work never delays joint states.
+  ros::CallbackQueue joint_state_queue_;
+  ros::CallbackQueue fixed_joint_queue_;
+  ros::CallbackQueue urdf_queue_;
+  bool dedicated_callback_threads_;
 
   Duration publish_interval_;
   Duration save_interval_;
-  robot_state_publisher::RobotStatePublisher state_publisher_;
+  RobotStatePublisherPtr state_publisher_;
   Subscriber joint_state_sub_;
   ros::Timer pub_timer_;
   ros::Timer save_timer_;
+  ros::Timer stats_timer_;
+  ros::Publisher diagnostics_pub_;
+  std::string diagnostics_namespace_;
   ros::Time last_callback_time_;
-  std::map<std::string, ros::Time> last_publish_time_;
+  // Last publish time per joint, indexed like the joint table.
+  std::vector<ros::Time> last_publish_time_;
+  // Per joint, when and at which position its transform was last sent; see joint_deadband.
+  std::vector<ros::Time> last_sent_time_;
+  std::vector<double> last_sent_position_;
+
+  // The last few joint name orderings received, so that several publishers
+  // with their own orderings, e.g. an arm and a gripper, each skip the name
+  // lookups.  Cleared with the joint table.
+  std::vector<JointOrdering> joint_orderings_;
+  uint64_t joint_ordering_publishes_;
+  uint64_t joint_ordering_uses_;
+  size_t cached_num_joints_;
+  unsigned int cached_joint_table_version_;
+
+  // Dense joint position buffers, reused across messages.
+  std::vector<double> joint_positions_;
+  std::vector<char> joint_valid_;
   bool use_tf_static_;
   bool ignore_timestamp_;
+  double joint_deadband_;
+  Duration keep_alive_interval_;
+
+  // Aggregation: the sources, and their last value cache indexed like the joint table.
+  std::vector<JointStateSource> sources_;
+  ros::Timer aggregate_timer_;
+  std::vector<double> aggregate_position_;
+  std::vector<ros::Time> aggregate_stamp_;     // Stamp of the message that set the position
+  std::vector<ros::Time> aggregate_received_;  // When that message arrived
+  std::vector<int> aggregate_source_;          // Index into sources_; -1 until set
+  std::vector<char> aggregate_pending_;        // Updated since the last batch
+  std::vector<ros::Time> aggregate_batch_stamp_;  // Per joint stamps of the batch being sent
+  // The sources and the aggregate timer may run at once on a multi-threaded queue, as in a nodelet.
+  boost::mutex aggregate_mtx_;
+
+  // Ingest ring; see ingest_queue_size.  The subscription callback only pushes
+  // the message, and the drain thread runs callbackJointState on it.
+  boost::scoped_ptr<boost::lockfree::spsc_queue<JointStateConstPtr> > ingest_ring_;
+  bool ingest_latest_only_;              // Drain only the newest message, skipping the rest
+  boost::thread ingest_thread_;
+  boost::mutex ingest_mutex_;            // Only guards the drain thread's sleep, not the ring
+  boost::condition_variable ingest_cond_;
+  std::atomic<bool> ingest_waiting_;     // The drain thread is, or is about to go, asleep
+  bool ingest_stop_;
+
+  bool configured_;
 
+  // Declared last, so the spinner threads stop before anything they use goes away.
+  std::vector<boost::shared_ptr<ros::AsyncSpinner> > spinners_;
 };
 }
 
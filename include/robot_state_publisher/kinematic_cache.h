@@ -0,0 +1,77 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// kinematic_cache.h
+// Compiled kinematic snapshots saved to disk, so that later starts can publish
+// without parsing the URDF.
+
+#ifndef ROBOT_STATE_PUBLISHER_KINEMATIC_CACHE_H_
+#define ROBOT_STATE_PUBLISHER_KINEMATIC_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "robot_state_publisher/robot_state_publisher.h"
+
+namespace robot_state_publisher {
+
+/** Reads and writes kinematic snapshots as versioned binary files.
+ *
+ * A file holds everything a snapshot publishes: the segment table with joint
+ * types, axes and tip offsets, the fixed transforms, the mimic relations and
+ * the frame ids.  It is keyed by a hash of the URDF text, its fragments and
+ * the tf prefix, and read through a memory map.  Segment inertias are not
+ * stored, as nothing is published from them; joints are rebuilt with unit
+ * scale and zero offset, as kdl_parser creates them.
+ */
+class KinematicCache
+{
+public:
+  static const uint32_t FORMAT_VERSION = 1;
+
+  /// \return the key of a description; stable across runs and builds.
+  static uint64_t key(const std::string& urdf, const std::vector<std::string>& fragments,
+                      const std::string& tf_prefix);
+
+  /// \return the file for a key within a cache directory.
+  static std::string file(const std::string& directory, uint64_t key);
+
+  /** \return the snapshot saved under a key, or NULL if the file is missing,
+   *  stale, of another format version or damaged.  The version is left at 0.
+   */
+  static KinematicSnapshotPtr load(const std::string& file, uint64_t key);
+
+  /// Save a snapshot, replacing the file atomically.  Creates the directory if needed.
+  static bool save(const std::string& file, uint64_t key, const KinematicSnapshot& snapshot);
+};
+
+}
+
+#endif /* ROBOT_STATE_PUBLISHER_KINEMATIC_CACHE_H_ */
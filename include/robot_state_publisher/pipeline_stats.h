@@ -0,0 +1,147 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// pipeline_stats.h
+// Lock-free latency histograms and counters for the joint state pipeline.
+
+#ifndef ROBOT_STATE_PUBLISHER_PIPELINE_STATS_H_
+#define ROBOT_STATE_PUBLISHER_PIPELINE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+/**
+ * RSP_STATS(statement) runs its statement only when the package is built with
+ * ROBOT_STATE_PUBLISHER_ENABLE_STATS; otherwise the instrumentation compiles
+ * out to nothing.  The classes below are always declared, so that the layout of
+ * the classes holding them does not depend on the flag.
+ */
+#ifdef ROBOT_STATE_PUBLISHER_ENABLE_STATS
+#define RSP_STATS(statement) statement
+#else
+#define RSP_STATS(statement)
+#endif
+
+namespace robot_state_publisher {
+
+/// Histogram of durations in power-of-two nanosecond buckets; safe to record from any thread.
+class LatencyHistogram
+{
+public:
+  static const int BUCKETS = 40;  // bucket i counts durations in [2^i, 2^(i+1)) ns
+
+  LatencyHistogram();
+
+  void record(uint64_t ns)
+  {
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= BUCKETS)  bucket = BUCKETS - 1;
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+  double mean() const;
+  /// Upper bound, in ns, of the bucket holding the given fraction of the samples.
+  uint64_t percentile(double fraction) const;
+
+private:
+  std::atomic<uint64_t> buckets_[BUCKETS];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+/// Where the time goes between a JointState message and its batch of transforms.
+class PipelineStats
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  typedef Clock::time_point TimePoint;
+
+  enum Stage
+  {
+    MESSAGE_AGE,   // From the message stamp to the callback, by the ROS clock
+    THROTTLE,      // Validation, joint index resolution and the publish throttle
+    CONVERT,       // Copying the message into the dense joint buffers
+    MIMIC,         // Mimic joint expansion
+    TRANSFORMS,    // Segment poses and their conversion to transforms
+    SEND,          // Handing the batch to tf
+    CALLBACK,      // The whole joint state callback
+    NUM_STAGES
+  };
+
+  enum Counter
+  {
+    RECEIVED,      // Joint state messages received
+    INVALID,       // Messages ignored as malformed
+    THROTTLED,     // Messages not published because of the publish interval
+    OVERFLOWED,    // Messages dropped because the ingest ring was full
+    SUPERSEDED,    // Messages skipped by latest-only ingest for a newer one
+    NUM_COUNTERS
+  };
+
+  static TimePoint now() { return Clock::now(); }
+
+  /// Record the time from start until now; returns now, to start the next stage.
+  TimePoint record(Stage stage, const TimePoint& start)
+  {
+    TimePoint end = now();
+    stages_[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    return end;
+  }
+  void record(Stage stage, uint64_t ns) { stages_[stage].record(ns); }
+  void count(Counter counter, uint64_t n = 1) { counters_[counter].fetch_add(n, std::memory_order_relaxed); }
+
+  const LatencyHistogram& stage(Stage stage) const { return stages_[stage]; }
+  uint64_t counter(Counter counter) const { return counters_[counter].load(std::memory_order_relaxed); }
+
+  static const char* stageName(Stage stage);
+  static const char* counterName(Counter counter);
+
+  /// Append the histograms and counters, in microseconds, to a diagnostic status.
+  void toDiagnostic(diagnostic_msgs::DiagnosticStatus& status) const;
+
+  PipelineStats();
+
+private:
+  LatencyHistogram stages_[NUM_STAGES];
+  std::atomic<uint64_t> counters_[NUM_COUNTERS];
+};
+
+}
+
+#endif /* ROBOT_STATE_PUBLISHER_PIPELINE_STATS_H_ */
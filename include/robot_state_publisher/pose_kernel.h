@@ -0,0 +1,86 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+// pose_kernel.h
+// Closed-form segment poses, specialized by joint type when the table is built.
+
+#ifndef ROBOT_STATE_PUBLISHER_POSE_KERNEL_H_
+#define ROBOT_STATE_PUBLISHER_POSE_KERNEL_H_
+
+#include <geometry_msgs/Transform.h>
+#include <kdl/frames.hpp>
+#include <kdl/segment.hpp>
+
+namespace robot_state_publisher {
+
+/** Evaluates KDL::Segment::pose() without the generic joint.
+ *
+ * The kind is picked once per segment: a revolute joint whose axis lines up
+ * with an axis of its tip frame turns two columns of the tip rotation with a
+ * single sin/cos pair, any other revolute joint composes one axis-angle
+ * rotation with the tip, a prismatic joint shifts the tip along its axis and a
+ * fixed joint returns the tip.  Every kernel is checked against the segment
+ * when it is built; segments it does not reproduce, e.g. joints with a scale
+ * or offset, keep going through the segment.
+ *
+ * transform() fills a message directly: the tip rotation is kept as a
+ * quaternion and composed with the half-angle quaternion of the joint, so no
+ * rotation matrix is built or converted.  The quaternion may have the
+ * opposite sign of the one KDL would give; both are the same rotation.
+ */
+class PoseKernel
+{
+public:
+  enum Kind { FIXED, ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION, TRANSLATION, GENERIC };
+
+  PoseKernel() : kind_(GENERIC), sign_(1.0), offset_(false) {}
+  explicit PoseKernel(const KDL::Segment& segment);
+
+  /// \return the pose of the tip relative to the root with the joint at q.
+  KDL::Frame pose(const KDL::Segment& segment, double q) const;
+
+  /// Fill a transform with the same pose as pose(), without a rotation matrix.
+  void transform(const KDL::Segment& segment, double q, geometry_msgs::Transform& transform) const;
+
+  Kind kind() const { return kind_; }
+
+private:
+  Kind kind_;
+  KDL::Frame tip_;        // Pose of the segment with its joint at zero
+  KDL::Vector axis_;      // Unit joint axis, in the root frame
+  KDL::Vector origin_;    // A point on the axis of a revolute joint
+  KDL::Vector local_;     // Tip position relative to origin_, in the tip frame
+  KDL::Vector local_axis_;  // Unit joint axis of a revolute joint, in the tip frame
+  double tip_quaternion_[4];  // tip_.M as x, y, z, w
+  double sign_;           // Direction of an axis-aligned rotation
+  bool offset_;           // Whether the tip is off the axis of a revolute joint
+};
+
+}
+
+#endif /* ROBOT_STATE_PUBLISHER_POSE_KERNEL_H_ */
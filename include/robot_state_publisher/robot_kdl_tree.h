@@ -71,6 +71,7 @@ class RobotKDLTree : public robot_urdf::RobotURDF
  protected:
   bool initFromURDF();
   bool getTreeFromURDF();
+  bool applyTreeChange(KDL::Tree & tree);
 
   RobotKDLTree();                             // The default constructer is for testing only
 
@@ -79,11 +80,15 @@ class RobotKDLTree : public robot_urdf::RobotURDF
  public:
   virtual bool init();
   virtual bool init(const std::string & urdfParamName);
+  virtual bool initFromString(const std::string & urdfString);
 
   virtual bool onURDFChange(const std::string &link_name);
   virtual void onURDFSwap(const std::string &link_name);
+  virtual bool syncBackground();
+  virtual void detachBackground();
+  virtual bool sharesModel() const;
 
-  const KDL::Tree & getTree()  { return *(m_treeFg.get()); }
+  const KDL::Tree & getTree()  { ensureModel(); return *(m_treeFg.get()); }
   const KDL::Tree & getBgTree()  { return *(m_treeBg.get()); }
 
  protected:
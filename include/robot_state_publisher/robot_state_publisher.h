@@ -41,13 +41,20 @@
 #include <boost/scoped_ptr.hpp>
 #include <urdf/model.h>
 #include <tf2_ros/static_transform_broadcaster.h>
-#include <tf2_ros/transform_broadcaster.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf2_msgs/TFMessage.h>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/shared_mutex.hpp>
 #include <kdl/frames.hpp>
 #include <kdl/segment.hpp>
 #include <kdl/tree.hpp>
 #include <robot_state_publisher/robot_kdl_tree.h>
+#include <robot_state_publisher/pipeline_stats.h>
+#include <robot_state_publisher/pose_kernel.h>
+#include <robot_state_publisher/shared_static_broadcaster.h>
 #include <urdf/model.h>
+#include <atomic>
+#include <list>
 #include <memory>
 
 namespace robot_state_publisher {
@@ -57,51 +64,292 @@ class SegmentPair
 {
 public:
   SegmentPair(const KDL::Segment& p_segment, const std::string& p_root, const std::string& p_tip):
-    segment(p_segment), root(p_root), tip(p_tip){}
+    segment(p_segment), root(p_root), tip(p_tip), kernel(p_segment){}
+
+  /// \return the same pose as segment.pose(q), through the precompiled kernel.
+  KDL::Frame pose(double q) const { return kernel.pose(segment, q); }
+  /// Fill a transform with pose(q), composed as a quaternion.
+  void transform(double q, geometry_msgs::Transform& transform) const { kernel.transform(segment, q, transform); }
 
   KDL::Segment segment;
   std::string root, tip;
+  PoseKernel kernel;
+};
+
+
+/// A mimic joint resolved against the joint table: position[dst] = position[src] * multiplier + offset.
+struct MimicJoint
+{
+  int dst, src;
+  double multiplier, offset;
+};
+
+
+/** Everything needed to publish the state of one version of the robot model.
+ * A snapshot is immutable once published; a URDF change builds a new one in
+ * the background and swaps it in atomically, so publishing never waits on a
+ * URDF change and never drops joint states because of one.
+ */
+class KinematicSnapshot
+{
+public:
+  KinematicSnapshot() : version(0) {}
+
+  /// \return the index into the joint table, or -1 if the joint is unknown or not moving.
+  int getJointIndex(const std::string& name) const;
+
+  /** Resolve joint names to indices in the joint table.
+   * \param names The joint names, e.g. from a JointState message.
+   * \param indices Filled with one index per name, -1 for unknown joints.
+   */
+  void getJointIndices(const std::vector<std::string>& names, std::vector<int>& indices) const;
+
+  void getJointMimicPositions(std::map<std::string, double>& joint_positions) const;
+  void getJointMimicPositions(std::vector<double>& joint_positions, std::vector<char>& joint_valid) const;
+
+  /** Resolve the mimic map against the joint table into mimic_joints.
+   * Call whenever either changes.  Joints are ordered so that a mimic of a
+   * mimic follows the joint it copies; mimic cycles are dropped.
+   */
+  void compileMimicJoints();
+
+  // Moving segments are stored in a dense joint table, indexed through joint_index.
+  std::vector<SegmentPair> joint_segments;
+  std::map<std::string, int> joint_index;
+  // Published frame id of every link, with the tf prefix applied and leading
+  // slashes stripped; resolved once per snapshot.
+  std::map<std::string, std::string> frame_ids;
+  // Per joint transform with the frame ids already filled in.
+  std::vector<geometry_msgs::TransformStamped> joint_transforms;
+  // Per joint, non-zero for continuous joints, whose positions wrap around.
+  std::vector<char> joint_continuous;
+  std::map<std::string, SegmentPair> segments_fixed;
+  // Fixed transforms only change with the model; they are built once and re-stamped on publish.
+  std::vector<geometry_msgs::TransformStamped> fixed_transforms;
+  MimicMap mimic;
+  // The mimic map compiled by compileMimicJoints(), in evaluation order.
+  std::vector<MimicJoint> mimic_joints;
+  unsigned int version;
 };
+typedef boost::shared_ptr<KinematicSnapshot> KinematicSnapshotPtr;
+typedef boost::shared_ptr<const KinematicSnapshot> KinematicSnapshotConstPtr;
 
 
 class RobotStatePublisher : public robot_kdl_tree::RobotKDLTree
 {
 public:
   virtual bool init();
+  virtual bool initFromString(const std::string &urdf_string);
 
+  virtual bool onURDFChange(const std::string &link_name);
   virtual void onURDFSwap(const std::string &link_name);
+  virtual bool syncBackground();
+  virtual void ensureModel();
 
-  /** Constructor
-   * \param tree The kinematic model of a robot, represented by a KDL Tree
-   */
-  RobotStatePublisher(const urdf::Model& model = urdf::Model());
+  /// Constructor; the model is loaded by init() or initFromString().
+  RobotStatePublisher();
 
   /// Destructor
   ~RobotStatePublisher(){};
 
   /** Publish transforms to tf
+   * Builds a message of its own on every call; safe to call from any thread.
    * \param joint_positions A map of joint names and joint positions.
    * \param time The time at which the joint positions were recorded
    */
   virtual void publishTransforms(const std::map<std::string, double>& joint_positions, const ros::Time& time);
+
+  /** Publish transforms to tf
+   * Reuses one message across calls; calls from several threads, e.g. a
+   * subclass publishing besides the joint state callback, take turns on it.
+   * \param snapshot The snapshot the joint indices were resolved against.
+   * \param joint_positions Joint positions indexed by joint table index.
+   * \param joint_valid Non-zero for each joint index whose position is set.
+   * \param time The time at which the joint positions were recorded
+   */
+  virtual void publishTransforms(const KinematicSnapshot& snapshot,
+                                 const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                 const ros::Time& time);
+
+  /** Publish transforms to tf, each joint stamped with the time it was
+   * recorded at, e.g. when joint states from several sources are merged into
+   * one batch.  Shares the message reused by the overload above.
+   * \param joint_stamps Recording time per joint table index; read for valid joints only.
+   */
+  virtual void publishTransforms(const KinematicSnapshot& snapshot,
+                                 const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                 const std::vector<ros::Time>& joint_stamps);
   virtual void publishFixedTransforms(bool use_tf_static = false);
+
+  /** Publish the fixed transforms to /tf under another tf prefix, e.g. to
+   * mirror the robot under a second name.  The relabelled transforms are
+   * built once per snapshot and prefix, and only re-stamped afterwards.
+   */
   void publishFixedTransforms(const std::string& tf_prefix);
   void setRobotDescriptionIfChanged();
   void setJointMimicMap(const urdf::Model& model);
   bool getJointMimicPositions(std::map<std::string, double>& joint_positions);
 
+  /** Publish moving transforms as shared messages rather than by reference.
+   * Subscribers in the same process, such as nodelets, then receive the
+   * message pointer without serialization.  The transforms are built right in
+   * messages from a small pool, which are only reused once no subscriber
+   * holds them, and go out through sendSharedTransforms().
+   */
+  void setPublishSharedMessages(bool shared) { publish_shared_messages_ = shared; }
+
+  /** Prefix the frame ids of every transform, e.g. "robot_1" publishes
+   * "robot_1/base_link".  Set before init().
+   */
+  void setTfPrefix(const std::string& tf_prefix);
+
+  /** Keep compiled snapshots in a directory; see KinematicCache.  When the
+   * description was seen before, init() publishes from the saved snapshot and
+   * the URDF is only parsed once needed, e.g. by the first getUrdfPtr() or
+   * getTree() (see ensureModel()).  Set before init().
+   */
+  void setKinematicCache(const std::string& directory) { kinematic_cache_dir_ = directory; }
+
+  /** Keep the models built for the last few sets of URDF fragments, so that
+   * going back to one, e.g. when a tool is put back on, swaps the model, tree
+   * and snapshot in instead of rebuilding them.  A cached model is shared with
+   * the foreground, so a change that misses the cache first copies the model
+   * and tree rather than replaying onto the previous foreground; enable it
+   * where a few fragment sets keep coming back.  0, the default, disables it.
+   */
+  void setModelCacheSize(size_t size);
+
+  /// Latency and drop statistics, recorded when built with ROBOT_STATE_PUBLISHER_ENABLE_STATS.
+  PipelineStats& getStats() { return stats_; }
+
+  /// \return the current kinematic snapshot; never blocks.
+  KinematicSnapshotConstPtr getSnapshot() const { return boost::atomic_load(&snapshot_); }
+
 protected:
-  virtual void addChildren(const KDL::SegmentMap::const_iterator segment);
+  /** Walk the tree and add its segments to a snapshot under construction.
+   * \param model The URDF the tree was built from, used to skip floating joints.
+   */
+  virtual void addChildren(const KDL::SegmentMap::const_iterator segment, const urdf::Model& model,
+                           KinematicSnapshot& snapshot);
+
+  /// \return the frame id published for a link, with the tf prefix and without a leading slash.
+  std::string frameId(const std::string& link) const;
+
+  /// \return the interned frame id of a link in a snapshot under construction.
+  const std::string& internFrameId(const std::string& link, KinematicSnapshot& snapshot) const;
+
+  /// Build a complete snapshot from a tree and the URDF model it came from.
+  KinematicSnapshotPtr buildSnapshot(const KDL::Tree& tree, const urdf::Model& model);
+
+  /// A model, tree and snapshot built for one set of URDF fragments; never modified once cached.
+  struct CachedModel
+  {
+    size_t key;
+    URDFFragmentMap fragments;
+    ConstStringPtr doc;
+    UrdfPtr model;
+    KDLTreePtr tree;
+    KinematicSnapshotPtr snapshot;
+  };
+
+  /// \return the key of the current set of fragments.
+  size_t fragmentSetKey() const;
+  /// Install the cached model for the current fragments as the background; false if there is none.
+  bool restoreCachedModel();
+  /// Cache the background built for the current fragments.
+  void cacheModel();
+  /// Copy background resources that are held by the cache before they are modified.
+  void detachCachedBackground();
+  /// Whether two fragment maps hold the same fragments; removed fragments are ignored.
+  static bool sameFragments(const URDFFragmentMap& a, const URDFFragmentMap& b);
+
+  /** A batch of moving transforms, reused across publishes.  Every joint's
+   * transform is labelled once per snapshot.  A joint left out of a batch,
+   * e.g. by the deadband, has its labelled transform parked rather than
+   * dropped, so a changing set of joints moves transforms around instead of
+   * relabelling them.
+   */
+  struct TransformBatch
+  {
+    TransformBatch() : message(new tf2_msgs::TFMessage()), version(0) {}
+
+    tf2_msgs::TFMessage::Ptr message;                     // The joints of the batch, in joint table order
+    std::vector<geometry_msgs::TransformStamped> parked;  // By joint index; holds the joints not in message
+    std::vector<int> joints;                              // Joint index of each transform in message
+    unsigned int version;                                 // The snapshot the transforms are labelled for
+  };
+
+  /// Fill in and send a batch; joint_stamps, if set, overrides time per joint.
+  void publishBatch(const KinematicSnapshot& snapshot,
+                    const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                    const ros::Time& time, const std::vector<ros::Time>* joint_stamps);
+
+  /// Lay out a batch for the valid joints and fill in their poses and stamps.
+  void fillBatch(TransformBatch& batch, const KinematicSnapshot& snapshot,
+                 const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                 const ros::Time& time, const std::vector<ros::Time>* joint_stamps);
+
+  /** Hand a batch of transforms to tf.
+   * Subclasses may override this to redirect or stub out the broadcasters.
+   */
+  virtual void sendTransforms(const tf2_msgs::TFMessage& message, bool use_tf_static);
+  /** Hand a batch of moving transforms built in the shared message pool to
+   * tf; see setPublishSharedMessages().  Subclasses overriding sendTransforms()
+   * may override this as well.
+   */
+  virtual void sendSharedTransforms(const tf2_msgs::TFMessageConstPtr& message);
+  /// \return a pooled batch that no subscriber holds any more.
+  TransformBatch& nextSharedBatch();
+  /// \return a pooled copy of a message for the shared messages.
+  tf2_msgs::TFMessageConstPtr nextSharedMessage(const tf2_msgs::TFMessage& message);
+
+  // Only ever replaced through boost::atomic_store.
+  KinematicSnapshotConstPtr snapshot_;
+  // Built by onURDFChange and published by onURDFSwap.
+  KinematicSnapshotPtr next_snapshot_;
+  unsigned int snapshot_count_;
+  // Fixed transforms of the current snapshot, re-stamped on publish.
+  tf2_msgs::TFMessage fixed_tf_message_;
+  unsigned int fixed_tf_version_;
+  // The fixed joint timer and URDF updates may publish from different threads.
+  boost::mutex fixed_tf_mtx_;
+  // Fixed transforms under the prefix last passed to publishFixedTransforms(tf_prefix).
+  tf2_msgs::TFMessage prefixed_fixed_tf_message_;
+  std::string prefixed_fixed_tf_prefix_;
+  unsigned int prefixed_fixed_tf_version_;
+  // Reused for every batch of moving transforms, so steady-state publishing does not allocate.
+  TransformBatch tf_batch_;
+  // With setPublishSharedMessages, the batches of moving transforms.
+  std::vector<TransformBatch> shared_tf_batches_;
+  size_t next_shared_tf_batch_;
+  // Held while a batch of moving transforms is filled and sent.
+  boost::mutex tf_batch_mtx_;
+  // Pool of copies of the other messages for setPublishSharedMessages; guarded by shared_tf_mtx_.
+  bool publish_shared_messages_;
+  std::vector<tf2_msgs::TFMessage::Ptr> shared_tf_messages_;
+  size_t next_shared_tf_message_;
+  boost::mutex shared_tf_mtx_;
+  // Advertised by init(); a publisher loaded with initFromString() alone needs no roscore.
+  ros::Publisher tf_pub_;
+  // Shared by every robot in the process, so /tf_static latches the fixed frames of all of them.
+  SharedStaticBroadcaster::Ptr static_tf_broadcaster_;
+  // Without slashes at either end; empty for no prefix.
+  std::string tf_prefix_;
+  std::string kinematic_cache_dir_;
+  // The description whose parsing was deferred by a kinematic cache hit;
+  // model_deferred_ lets ensureModel() skip the lock once it was parsed.
+  std::string deferred_urdf_;
+  boost::mutex deferred_urdf_mtx_;
+  std::atomic<bool> model_deferred_;
+  // Models built for recent fragment sets, most recently used first; only
+  // touched from URDF updates, which hold the update lock.
+  std::list<CachedModel> model_cache_;
+  size_t model_cache_size_;
 
-  std::map<std::string, SegmentPair> segments_, segments_fixed_;
-  const urdf::Model& model_;
-  tf2_ros::TransformBroadcaster tf_broadcaster_;
-  tf2_ros::StaticTransformBroadcaster static_tf_broadcaster_;
+  PipelineStats stats_;
 
   bool initialized_;
   bool urdf_changed_;
-  MimicMap mimic_;
-  boost::shared_mutex mimic_mtx_;
 };
 
 }
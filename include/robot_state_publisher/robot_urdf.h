@@ -34,10 +34,13 @@
 #ifndef ROBOT_URDF_H_
 #define ROBOT_URDF_H_
 
+#include <atomic>
 #include <map>
 #include <vector>
 #include <string>
 #include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/signals2.hpp>
 
@@ -50,6 +53,8 @@
 #include <urdf/model.h>
 #include <intera_core_msgs/URDFConfiguration.h>
 
+#include "robot_state_publisher/shared_model.h"
+
 namespace robot_urdf {
 
 /**
@@ -127,20 +132,43 @@ class RobotURDF
  public:
   typedef boost::shared_ptr<urdf::Model> UrdfPtr;
   typedef boost::shared_ptr<const urdf::Model> ConstUrdfPtr;
+  typedef boost::shared_ptr<const std::string> ConstStringPtr;
 
   RobotURDF();
+  virtual ~RobotURDF();
 
   bool init();  // Load the default urdf parameter
   bool init(const std::string & urdfParamName);
 
+  // Load a URDF document without the parameter server or the URDFConfiguration subscriber.
+  virtual bool initFromString(const std::string & urdfString);
+
 
   bool isValid() const { return m_valid; }
 
+  // URDF updates dropped because the update or swap lock was busy.
+  uint32_t getUpdateLockBusyCount() const { return m_updateLockBusy; }
+  uint32_t getSwapLockBusyCount() const { return m_swapLockBusy; }
+
+  // Queue for the URDFConfiguration subscriber; the global queue by default.  Set before init().
+  void setCallbackQueue(ros::CallbackQueueInterface * queue) { m_callbackQueue = queue; }
+
+  // Namespace of the description parameters and the URDFConfiguration topic,
+  // so that one process can serve several robots; the root namespace by default.  Set before init().
+  void setNamespace(const std::string & ns);
 
-  ConstUrdfPtr getUrdfPtr() { return m_urdfPtrFg; }
+
+  ConstUrdfPtr getUrdfPtr() { ensureModel(); return m_urdfPtrFg; }
   ConstUrdfPtr getUrdfBgPtr() { return m_urdfPtrBg; }
 
-  // Write the current URDF to the /robot_description parameter:
+  // Parse the model if its loading was deferred, e.g. because the kinematic
+  // snapshot came from a cache.  getUrdfPtr(), RobotKDLTree::getTree() and
+  // URDF updates call this first, so the model is parsed on first use.
+  virtual void ensureModel() {}
+
+  // Queue the current URDF to be written to the /robot_description parameter.
+  // The write happens on a background thread; requests made while a write is
+  // in progress are coalesced, and only the latest document is written.
   void setRobotDescription();
 
  protected:
@@ -150,20 +178,54 @@ class RobotURDF
     std::string parentLink;
     std::string jointName;
     std::string xml;
+    bool        grafted;       // links and joints below are valid
+    std::vector<std::string> links;   // Links and joints the fragment added to the model
+    std::vector<std::string> joints;
   } URDFFragment;
   typedef std::map<std::string, URDFFragment> URDFFragmentMap;
 
+  // The fragment change being applied, so that it can be grafted onto the
+  // background model and replayed on the other model after the swap.
+  typedef struct
+  {
+    std::string key;
+    URDFFragment previous;     // The fragment as it was before this change
+    UrdfPtr fragment;          // The parsed fragment, rooted at its parent link; NULL if removed
+    bool incremental;          // Whether the change was grafted rather than fully regenerated
+  } URDFChange;
+
   URDFFragmentMap m_urdfMap;
-  std::string     m_urdfBase;    // Base URDF document
-  std::string     m_urdfDoc;     // Current URDF document, for reference
+  ConstStringPtr  m_urdfBase;    // Base URDF document
+  std::size_t     m_urdfBaseEnd; // Offset of the base's closing root tag, where fragments go; npos if missing
+  ConstStringPtr  m_urdfDoc;     // Current URDF document, for reference; the base itself without fragments
+  std::string     m_namespace;
+
+  // The model this robot was loaded from, while the foreground or background
+  // resources are still the ones shared with other robots; see SharedModel.
+  SharedModel::Ptr m_sharedModel;
 
   UrdfPtr m_urdfPtrFg;
   UrdfPtr m_urdfPtrBg;
   void swap()  {  m_urdfPtrFg.swap(m_urdfPtrBg); }
 
+  URDFChange m_change;
+  bool m_bgStale;          // The background resources lag behind the foreground ones
+
   bool m_valid;
   uint32_t m_updateCount;  // debug
+  std::atomic<uint32_t> m_updateLockBusy;
+  std::atomic<uint32_t> m_swapLockBusy;
   ros::Subscriber         m_URDFConfigurationSubscriber;
+  ros::CallbackQueueInterface * m_callbackQueue;
+
+  // Background /robot_description writer
+  boost::thread    m_writerThread;
+  boost::mutex     m_writerMutex;
+  boost::condition_variable m_writerCond;
+  ConstStringPtr   m_writerDoc;       // Latest document waiting to be written
+  uint32_t         m_writerPending;   // Requests since the last write
+  bool             m_writerStop;
+  void descriptionWriterLoop();
 
   static std::string makeKey(const std::string & linkName, const std::string & jointName)
     {  return linkName + "/" + jointName;  }
@@ -172,11 +234,24 @@ class RobotURDF
                              const std::string & linkName,
                              const std::string & jointName);
 
+  static void cloneModel(const urdf::Model & source, urdf::Model & target);
+  // Build m_urdfDoc from the base and the fragments in one pass; the base itself while there are none.
+  void assembleUrdfDoc();
   bool regenerateUrdf();
 
+  bool canGraft(const URDFChange & change) const;
+  bool parseFragment(URDFFragment & fragment, UrdfPtr & model) const;
+  static bool graftFragment(urdf::Model & target, const urdf::Model & fragment, const std::string & parentLink);
+  static void pruneFragment(urdf::Model & target, const URDFFragment & fragment);
+  bool applyChange(urdf::Model & target);
+  bool updateUrdf();
+
   void onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration &config);
   virtual bool onURDFChange(const std::string &link_name);
   virtual void onURDFSwap(const std::string &link_name);
+  virtual bool syncBackground();
+  virtual void detachBackground();
+  virtual bool sharesModel() const;
 
  public:
   mutable boost::shared_mutex m_swapMutex;    // Protect access while swapping shared pointers.
@@ -0,0 +1,76 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// shared_model.h
+// Parsed robot models shared by every robot in a process loaded from the same document.
+
+#ifndef ROBOT_STATE_PUBLISHER_SHARED_MODEL_H_
+#define ROBOT_STATE_PUBLISHER_SHARED_MODEL_H_
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <kdl/tree.hpp>
+#include <urdf/model.h>
+
+namespace robot_urdf {
+
+/** A URDF document with its parsed model and KDL tree, built once per
+ * distinct document in the process.
+ *
+ * Robots loaded from the same document point their foreground and background
+ * resources at one SharedModel.  It is never modified: a robot copies what it
+ * is about to change when it receives its own URDFConfiguration, and the
+ * SharedModel goes away with the last robot still using it.
+ */
+class SharedModel
+{
+ public:
+  typedef boost::shared_ptr<SharedModel> Ptr;
+
+  /** \return the model for a document, parsed only if no robot in the process
+   *  holds one for the same content.  Safe to call from any thread.
+   */
+  static Ptr acquire(const std::string & doc);
+
+  /// \return how many distinct documents are currently shared.
+  static size_t count();
+
+  boost::shared_ptr<const std::string> doc;  // Outlives the models while robots reference it
+  urdf::Model model;
+  KDL::Tree   tree;
+  bool        modelValid;
+  bool        treeValid;
+
+ private:
+  SharedModel() : modelValid(false), treeValid(false) {}
+};
+
+}  // namespace robot_urdf
+
+#endif /* ROBOT_STATE_PUBLISHER_SHARED_MODEL_H_ */
@@ -0,0 +1,74 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// shared_static_broadcaster.h
+// The one /tf_static broadcaster shared by every robot in a process.
+
+#ifndef ROBOT_STATE_PUBLISHER_SHARED_STATIC_BROADCASTER_H_
+#define ROBOT_STATE_PUBLISHER_SHARED_STATIC_BROADCASTER_H_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+
+namespace robot_state_publisher {
+
+/** Collects the fixed transforms of every robot in the process on /tf_static.
+ *
+ * roscpp keeps a single latched publication per topic and process, which only
+ * holds the last message sent on it, so robots with broadcasters of their own
+ * would leave late subscribers with the fixed frames of just one of them.
+ * Sending through one broadcaster merges the frames of all robots instead: a
+ * transform replaces only an earlier one with the same child frame.
+ */
+class SharedStaticBroadcaster
+{
+ public:
+  typedef boost::shared_ptr<SharedStaticBroadcaster> Ptr;
+
+  /** \return the broadcaster of the process, advertised on first use and
+   *  released with the last robot holding it.  Safe to call from any thread.
+   */
+  static Ptr acquire();
+
+  /// Adds or replaces transforms in the latched message; safe from any thread.
+  void sendTransform(const std::vector<geometry_msgs::TransformStamped> & transforms);
+
+ private:
+  SharedStaticBroadcaster() {}
+
+  boost::mutex mutex_;
+  tf2_ros::StaticTransformBroadcaster broadcaster_;
+};
+
+}  // namespace robot_state_publisher
+
+#endif /* ROBOT_STATE_PUBLISHER_SHARED_STATIC_BROADCASTER_H_ */
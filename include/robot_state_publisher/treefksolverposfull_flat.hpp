@@ -0,0 +1,157 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// treefksolverposfull_flat.hpp
+// Forward kinematics for every segment of a tree, evaluated over a flattened,
+// topologically ordered copy of the tree.
+
+#ifndef KDLTREEFKSOLVERPOSFULL_FLAT_HPP
+#define KDLTREEFKSOLVERPOSFULL_FLAT_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kdl/tree.hpp>
+#include <tf2/transform_datatypes.h>
+
+namespace KDL {
+
+/**
+ * Drop-in alternative to TreeFkSolverPosFull_recursive.
+ *
+ * The tree is compiled once into an array of segments in depth-first order, so
+ * that every parent precedes its children.  JntToCart() then computes all
+ * segment poses in one linear pass over that array, reading joint positions by
+ * index instead of by name.  The poses are bit-identical to those of the
+ * recursive solver.
+ *
+ * Segment 0 is the root of the tree.  Its pose is always the identity and it is
+ * not reported by the map-based JntToCart(), matching the recursive solver.
+ *
+ * JntToCartBatch() evaluates many configurations at once, in structure-of-arrays
+ * form, so that Eigen can process several configurations per SIMD instruction.
+ */
+class TreeFkSolverPosFull_flat
+{
+public:
+  /// One row per configuration; every column is contiguous.
+  typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> BatchArray;
+  /// Columns per segment in a batch of poses: the rotation, row major, then the position.
+  static const int BATCH_FRAME_SIZE = 12;
+
+  explicit TreeFkSolverPosFull_flat(const Tree& _tree);
+  ~TreeFkSolverPosFull_flat();
+
+  /// Segment names, in evaluation order.
+  const std::vector<std::string>& getSegmentNames() const { return segment_names; }
+  /// Index of each segment's parent; -1 for the root.
+  const std::vector<int>& getSegmentParents() const { return segment_parents; }
+  /// Names of the moving joints, in the order JntToCart() expects their positions.
+  const std::vector<std::string>& getJointNames() const { return joint_names; }
+
+  unsigned int getNrOfSegments() const { return nodes.size(); }
+  unsigned int getNrOfJoints() const { return joint_names.size(); }
+  /// Index of a segment, or -1 if it is not in the tree.
+  int getSegmentIndex(const std::string& name) const;
+  /// Index of a moving joint, or -1 if it is not in the tree.
+  int getJointIndex(const std::string& name) const;
+
+  /**
+   * Compute the pose of every segment.
+   *
+   * \param q_in       Joint positions, indexed as getJointNames().
+   * \param q_valid    Non-zero for each joint position that is known.
+   * \param p_out      Resized to getNrOfSegments(); pose of each segment, in the
+   *                   root frame, or in its parent's frame if flatten_tree is false.
+   * \param p_valid    Resized to getNrOfSegments(); zero for segments below a
+   *                   joint without a position, which are skipped.
+   */
+  int JntToCart(const std::vector<double>& q_in, const std::vector<char>& q_valid,
+                std::vector<Frame>& p_out, std::vector<char>& p_valid, bool flatten_tree=true) const;
+
+  /// Same interface as TreeFkSolverPosFull_recursive::JntToCart().
+  int JntToCart(const std::map<std::string, double>& q_in, std::map<std::string, tf2::Stamped<Frame> >& p_out, bool flatten_tree=true);
+
+  /**
+   * Compute the pose of every segment for many configurations.
+   *
+   * \param q_in     One row per configuration, one column per joint of getJointNames().
+   *                 Every joint must have a position.
+   * \param p_out    Resized to one row per configuration and BATCH_FRAME_SIZE
+   *                 columns per segment; see getBatchFrame().
+   *
+   * The results agree with JntToCart() to within rounding, not bit for bit.
+   */
+  int JntToCartBatch(const BatchArray& q_in, BatchArray& p_out, bool flatten_tree=true) const;
+
+  /// Pose of a segment in one configuration of a JntToCartBatch() result.
+  static Frame getBatchFrame(const BatchArray& p, int config, int segment);
+
+private:
+  // Hot, per-segment data, stored contiguously in evaluation order.
+  struct Node
+  {
+    int parent;             // Index of the parent node; -1 for the root
+    int joint;              // Index into the joint positions; -1 for fixed joints
+    Joint::JointType type;
+    Frame fixed;            // Pose of a fixed segment, precomputed
+  };
+
+  // How JntToCartBatch() evaluates a segment's pose
+  struct BatchKernel
+  {
+    enum Kind { FIXED, ROTATION, TRANSLATION, GENERIC } kind;
+    Vector axis;    // Unit joint axis
+    Vector origin;  // A point on the axis of a rotational joint
+    Frame tip;      // Pose of the segment with its joint at zero
+  };
+
+  void addSegment(const SegmentMap::const_iterator segment, int parent);
+  void buildBatchKernel(int index);
+
+  std::vector<Node> nodes;
+  std::vector<BatchKernel> kernels;
+  std::vector<Segment> segments;   // Evaluated only for moving joints
+  std::vector<std::string> segment_names;
+  std::vector<int> segment_parents;
+  std::vector<std::string> joint_names;
+  std::map<std::string, int> segment_index;
+  std::map<std::string, int> joint_index;
+
+  // Scratch buffers for the map-based interface
+  std::vector<double> q_scratch;
+  std::vector<char> q_valid_scratch;
+  std::vector<Frame> p_scratch;
+  std::vector<char> p_valid_scratch;
+};
+}
+
+#endif
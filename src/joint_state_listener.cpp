@@ -34,10 +34,15 @@
 
 /* Author: Wim Meeussen */
 
+#include <cmath>
+
+#include <boost/bind/bind.hpp>
+#include <boost/functional/hash.hpp>
 #include <ros/ros.h>
 #include <urdf/model.h>
 #include <kdl/tree.hpp>
 #include <kdl_parser/kdl_parser.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include "robot_state_publisher/robot_state_publisher.h"
 #include "robot_state_publisher/joint_state_listener.h"
@@ -47,11 +52,43 @@ using namespace ros;
 using namespace KDL;
 using namespace robot_state_publisher;
 
-JointStateListener::JointStateListener(const urdf::Model& model)
-  : state_publisher_(model)
+JointStateListener::JointStateListener()
+  : dedicated_callback_threads_(true), publish_interval_(1.0/50.0), save_interval_(1.0/20.0),
+    state_publisher_(new RobotStatePublisher()), joint_ordering_publishes_(0), joint_ordering_uses_(0),
+    cached_num_joints_(0), cached_joint_table_version_(0),
+    use_tf_static_(true), ignore_timestamp_(false), joint_deadband_(0.0), keep_alive_interval_(1.0),
+    ingest_latest_only_(false), ingest_waiting_(false), ingest_stop_(false), configured_(false)
+{
+}
+
+JointStateListener::JointStateListener(const RobotStatePublisherPtr& state_publisher)
+  : dedicated_callback_threads_(true), publish_interval_(1.0/50.0), save_interval_(1.0/20.0),
+    state_publisher_(state_publisher), joint_ordering_publishes_(0), joint_ordering_uses_(0),
+    cached_num_joints_(0), cached_joint_table_version_(0),
+    use_tf_static_(true), ignore_timestamp_(false), joint_deadband_(0.0), keep_alive_interval_(1.0),
+    ingest_latest_only_(false), ingest_waiting_(false), ingest_stop_(false), configured_(false)
 {
-  ros::NodeHandle n_tilde("~");
-  ros::NodeHandle n;
+}
+
+void JointStateListener::setup(const ros::NodeHandle& n, const ros::NodeHandle& n_tilde)
+{
+  // serve joint states, fixed joints and URDF updates from their own threads,
+  // unless whoever embeds the listener serves the queues
+  if (dedicated_callback_threads_) {
+    n_tilde.param("dedicated_callback_threads", dedicated_callback_threads_, true);
+  }
+  ros::NodeHandle n_joint_state(n), n_fixed_joint(n_tilde), n_urdf(n_tilde);
+  if (dedicated_callback_threads_) {
+    n_joint_state.setCallbackQueue(&joint_state_queue_);
+    n_fixed_joint.setCallbackQueue(&fixed_joint_queue_);
+    n_urdf.setCallbackQueue(&urdf_queue_);
+    state_publisher_->setCallbackQueue(&urdf_queue_);
+  }
+  else {
+    // URDF updates and saves share the private queue, which must not run
+    // callbacks concurrently: both touch the URDF document unguarded
+    state_publisher_->setCallbackQueue(n_tilde.getCallbackQueue());
+  }
 
   // set publish frequency
   double publish_freq;
@@ -60,6 +97,22 @@ JointStateListener::JointStateListener(const urdf::Model& model)
   n_tilde.param("use_tf_static", use_tf_static_, true);
   // ignore_timestamp_ == true, joins_states messages are accepted, no matter their timestamp
   n_tilde.param("ignore_timestamp", ignore_timestamp_, false);
+  // joints that moved less than joint_deadband since they were last sent are
+  // not re-sent until keep_alive_interval has passed; 0 sends every joint
+  n_tilde.param("joint_deadband", joint_deadband_, 0.0);
+  double keep_alive;
+  n_tilde.param("keep_alive_interval", keep_alive, 1.0);
+  keep_alive_interval_ = ros::Duration(keep_alive);
+  // directory of compiled kinematic models, to start without parsing the URDF; empty disables it
+  std::string kinematic_cache;
+  if (n_tilde.getParam("kinematic_cache", kinematic_cache)) {
+    state_publisher_->setKinematicCache(kinematic_cache);
+  }
+  // models kept for recent sets of URDF fragments, so that repeated tool changes skip the rebuild; 0 (default) disables it
+  int model_cache_size;
+  if (n_tilde.getParam("model_cache_size", model_cache_size)) {
+    state_publisher_->setModelCacheSize(max(model_cache_size, 0));
+  }
   // get the tf_prefix parameter from the closest namespace
   publish_interval_ = ros::Duration(1.0/max(publish_freq,1.0));
   save_interval_ = ros::Duration(1.0/20.0);
@@ -69,12 +122,72 @@ JointStateListener::JointStateListener(const urdf::Model& model)
   // from being bundled together, increasing the latency of one of the messages.
   ros::TransportHints transport_hints;
   transport_hints.tcpNoDelay(true);
-  // subscribe to joint state
-  joint_state_sub_ = n.subscribe("joint_states", 1, &JointStateListener::callbackJointState, this, transport_hints);
+  // Either merge several joint state sources into one batch per publish
+  // interval, or publish each message from joint_states as it arrives.
+  // aggregate_sources lists topics, or {topic, max_age} structs.  A batch
+  // carries the joints updated since the last one, each stamped with the
+  // message that set it, so no joint is sent twice for one measurement; an
+  // update older than max_age seconds (default aggregate_max_age) by the time
+  // of the batch is dropped.
+  XmlRpc::XmlRpcValue sources;
+  if (n_tilde.getParam("aggregate_sources", sources)) {
+    double default_max_age;
+    n_tilde.param("aggregate_max_age", default_max_age, 0.5);
+    for (int i = 0; sources.getType() == XmlRpc::XmlRpcValue::TypeArray && i < sources.size(); ++i) {
+      JointStateSource source;
+      source.max_age = ros::Duration(default_max_age);
+      source.cached_joint_table_version = 0;
+      if (sources[i].getType() == XmlRpc::XmlRpcValue::TypeString) {
+        source.topic = static_cast<std::string&>(sources[i]);
+      }
+      else if (sources[i].getType() == XmlRpc::XmlRpcValue::TypeStruct && sources[i].hasMember("topic")) {
+        source.topic = static_cast<std::string&>(sources[i]["topic"]);
+        if (sources[i].hasMember("max_age")) {
+          source.max_age = ros::Duration(static_cast<double&>(sources[i]["max_age"]));
+        }
+      }
+      else {
+        ROS_ERROR("robot_state_publisher: ignoring aggregate source %d; expected a topic or a {topic, max_age} struct", i);
+        continue;
+      }
+      sources_.push_back(source);
+    }
+  }
+  if (!sources_.empty()) {
+    for (size_t i = 0; i < sources_.size(); ++i) {
+      ROS_INFO("Aggregating joint states from %s (max age %.3f s)", sources_[i].topic.c_str(), sources_[i].max_age.toSec());
+      sources_[i].sub = n_joint_state.subscribe<sensor_msgs::JointState>(sources_[i].topic, 10,
+          boost::bind(&JointStateListener::callbackSourceJointState, this, boost::placeholders::_1, i), ros::VoidConstPtr(), transport_hints);
+    }
+    aggregate_timer_ = n_joint_state.createTimer(publish_interval_, &JointStateListener::callbackAggregate, this);
+  }
+  else {
+    // With ingest_queue_size > 0, messages go into a lock-free ring that a
+    // drain thread works through, so a busy publisher (e.g. regenerating the
+    // URDF) no longer makes the size 1 subscriber queue drop them.
+    // ingest_mode "all" processes every message, "latest" only the newest one
+    // waiting in the ring.
+    int ingest_queue_size;
+    n_tilde.param("ingest_queue_size", ingest_queue_size, 0);
+    if (ingest_queue_size > 0) {
+      std::string ingest_mode;
+      n_tilde.param("ingest_mode", ingest_mode, std::string("all"));
+      if (ingest_mode != "all" && ingest_mode != "latest") {
+        ROS_WARN("robot_state_publisher: unknown ingest_mode '%s', processing all messages", ingest_mode.c_str());
+      }
+      ingest_latest_only_ = (ingest_mode == "latest");
+      ingest_ring_.reset(new boost::lockfree::spsc_queue<JointStateConstPtr>(ingest_queue_size));
+      ingest_thread_ = boost::thread(&JointStateListener::ingestDrainLoop, this);
+      joint_state_sub_ = n_joint_state.subscribe("joint_states", ingest_queue_size, &JointStateListener::callbackIngestJointState, this, transport_hints);
+    }
+    else {
+      joint_state_sub_ = n_joint_state.subscribe("joint_states", 1, &JointStateListener::callbackJointState, this, transport_hints);
+    }
+  }
 
   // trigger to publish fixed joints
   // if using static transform broadcaster, this will be a oneshot trigger and only run once
-  pub_timer_ = n_tilde.createTimer(publish_interval_, &JointStateListener::callbackFixedJoint, this, use_tf_static_);
+  pub_timer_ = n_fixed_joint.createTimer(publish_interval_, &JointStateListener::callbackFixedJoint, this, use_tf_static_);
 
   // Only one node should set the robot_description parameter:
   bool set_robot_description = false;
@@ -82,33 +195,351 @@ JointStateListener::JointStateListener(const urdf::Model& model)
   if (set_robot_description)
   {
     ROS_INFO("This node will set the robot_description parameter.");
-    save_timer_ = n_tilde.createTimer(save_interval_, &JointStateListener::callbackSaveUrdf, this);
+    save_timer_ = n_urdf.createTimer(save_interval_, &JointStateListener::callbackSaveUrdf, this);
   }
-};
+
+#ifdef ROBOT_STATE_PUBLISHER_ENABLE_STATS
+  // periodically report pipeline latencies on /diagnostics; 0 disables the report
+  double stats_period;
+  n_tilde.param("stats_period", stats_period, 5.0);
+  if (stats_period > 0.0) {
+    // robots hosted in one process are told apart by their namespace
+    if (n.getNamespace() != ros::this_node::getNamespace())  diagnostics_namespace_ = n.getNamespace();
+    diagnostics_pub_ = ros::NodeHandle(n).advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    stats_timer_ = n_fixed_joint.createTimer(ros::Duration(stats_period), &JointStateListener::callbackStats, this);
+  }
+#endif
+}
 
 bool JointStateListener::init()
 {
-  return state_publisher_.init();
+  return init(ros::NodeHandle(), ros::NodeHandle("~"));
+}
+
+bool JointStateListener::init(const ros::NodeHandle& n, const ros::NodeHandle& n_private)
+{
+  if (!configured_) {
+    setup(n, n_private);
+    configured_ = true;
+  }
+  if (!state_publisher_->init())
+    return false;
+
+  if (dedicated_callback_threads_ && spinners_.empty()) {
+    ros::CallbackQueue* queues[] = { &joint_state_queue_, &fixed_joint_queue_, &urdf_queue_ };
+    for (size_t i = 0; i < sizeof(queues) / sizeof(queues[0]); ++i) {
+      spinners_.push_back(boost::shared_ptr<ros::AsyncSpinner>(new ros::AsyncSpinner(1, queues[i])));
+      spinners_.back()->start();
+    }
+  }
+  return true;
 }
 
 
 JointStateListener::~JointStateListener()
-{}
+{
+  stopIngest();
+}
+
+void JointStateListener::stopIngest()
+{
+  {
+    boost::mutex::scoped_lock lock(ingest_mutex_);
+    ingest_stop_ = true;
+  }
+  ingest_cond_.notify_one();
+  if (ingest_thread_.joinable())
+    ingest_thread_.join();
+}
+
+// Constant work per message.  roscpp never runs one subscription's callback
+// concurrently, so this is the ring's only producer.
+void JointStateListener::callbackIngestJointState(const JointStateConstPtr& state)
+{
+  if (!ingest_ring_->push(state)) {
+    RSP_STATS(state_publisher_->getStats().count(PipelineStats::OVERFLOWED));
+    ROS_WARN_THROTTLE(10, "Robot state publisher dropped a JointState message because the ingest ring is full; "
+                      "consider raising ingest_queue_size");
+  }
+  // pairs with the fence in ingestDrainLoop: either the drain thread sees the
+  // message before sleeping, or this sees it waiting and wakes it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ingest_waiting_.load(std::memory_order_relaxed)) {
+    boost::mutex::scoped_lock lock(ingest_mutex_);
+    ingest_cond_.notify_one();
+  }
+}
+
+// The ring's only consumer: feeds messages to callbackJointState until stopped.
+void JointStateListener::ingestDrainLoop()
+{
+  JointStateConstPtr state, newest;
+  while (true) {
+    uint64_t drained = 0;
+    while (ingest_ring_->pop(state)) {
+      ++drained;
+      if (ingest_latest_only_) {
+        newest.swap(state);
+      }
+      else {
+        callbackJointState(state);
+      }
+    }
+    if (newest) {
+      RSP_STATS(state_publisher_->getStats().count(PipelineStats::SUPERSEDED, drained - 1));
+      callbackJointState(newest);
+      newest.reset();
+    }
+    state.reset();
+
+    boost::mutex::scoped_lock lock(ingest_mutex_);
+    if (ingest_stop_)
+      break;
+    ingest_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ingest_ring_->read_available())
+      ingest_cond_.wait(lock);
+    ingest_waiting_.store(false, std::memory_order_relaxed);
+  }
+}
 
 void JointStateListener::callbackSaveUrdf(const ros::TimerEvent& e)
 {
-  state_publisher_.setRobotDescriptionIfChanged();
+  state_publisher_->setRobotDescriptionIfChanged();
+}
+
+void JointStateListener::callbackStats(const ros::TimerEvent& e)
+{
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.resize(1);
+  diagnostic_msgs::DiagnosticStatus& status = diagnostics.status[0];
+  status.name = ros::this_node::getName() + ": joint state pipeline";
+  if (!diagnostics_namespace_.empty())  status.name += " (" + diagnostics_namespace_ + ")";
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "OK";
+  state_publisher_->getStats().toDiagnostic(status);
+
+  // URDF updates dropped because another update or a swap held the lock
+  diagnostic_msgs::KeyValue kv;
+  kv.key = "urdf update lock busy";
+  kv.value = std::to_string(state_publisher_->getUpdateLockBusyCount());
+  status.values.push_back(kv);
+  kv.key = "urdf swap lock busy";
+  kv.value = std::to_string(state_publisher_->getSwapLockBusyCount());
+  status.values.push_back(kv);
+
+  diagnostics_pub_.publish(diagnostics);
 }
 
 void JointStateListener::callbackFixedJoint(const ros::TimerEvent& e)
 {
   (void)e;
-  state_publisher_.publishFixedTransforms(use_tf_static_);
+  state_publisher_->publishFixedTransforms(use_tf_static_);
+}
+
+// Size the per joint state for a new joint table; everything is re-sent.
+void JointStateListener::resetJointTable(const KinematicSnapshot& snapshot)
+{
+  cached_num_joints_ = snapshot.joint_segments.size();
+  cached_joint_table_version_ = snapshot.version;
+  joint_orderings_.clear();
+  last_publish_time_.assign(cached_num_joints_, ros::Time());
+  last_sent_time_.assign(cached_num_joints_, ros::Time());
+  last_sent_position_.assign(cached_num_joints_, 0.0);
+  aggregate_position_.assign(cached_num_joints_, 0.0);
+  aggregate_stamp_.assign(cached_num_joints_, ros::Time());
+  aggregate_received_.assign(cached_num_joints_, ros::Time());
+  aggregate_source_.assign(cached_num_joints_, -1);
+  aggregate_pending_.assign(cached_num_joints_, 0);
+  aggregate_batch_stamp_.assign(cached_num_joints_, ros::Time());
+}
+
+// Merge a partial joint state into the last value cache.
+void JointStateListener::callbackSourceJointState(const JointStateConstPtr& state, size_t source_index)
+{
+  RSP_STATS(state_publisher_->getStats().count(PipelineStats::RECEIVED));
+  JointStateSource& source = sources_[source_index];
+  if (state->name.size() != state->position.size()) {
+    RSP_STATS(state_publisher_->getStats().count(PipelineStats::INVALID));
+    ROS_ERROR_THROTTLE(10, "Robot state publisher ignored an invalid JointState message from %s", source.topic.c_str());
+    return;
+  }
+
+  boost::mutex::scoped_lock lock(aggregate_mtx_);
+
+  KinematicSnapshotConstPtr snapshot = state_publisher_->getSnapshot();
+  if (snapshot->version != cached_joint_table_version_) {
+    resetJointTable(*snapshot);
+  }
+  if (source.cached_joint_table_version != snapshot->version || source.cached_joint_names != state->name) {
+    snapshot->getJointIndices(state->name, source.cached_joint_indices);
+    source.cached_joint_table_version = snapshot->version;
+    source.cached_joint_names = state->name;
+  }
+
+  ros::Time now = ros::Time::now();
+  for (size_t i = 0; i < state->name.size(); ++i) {
+    int idx = source.cached_joint_indices[i];
+    if (idx >= 0) {
+      aggregate_position_[idx] = state->position[i];
+      aggregate_stamp_[idx] = state->header.stamp;
+      aggregate_received_[idx] = now;
+      aggregate_source_[idx] = source_index;
+      aggregate_pending_[idx] = 1;
+    }
+  }
+}
+
+// Publish one batch with every joint updated in the last value cache since the
+// previous batch.  Each joint keeps the stamp of its own message, rather than
+// being sent at a time it was never measured at.
+void JointStateListener::callbackAggregate(const ros::TimerEvent& e)
+{
+  boost::mutex::scoped_lock lock(aggregate_mtx_);
+  KinematicSnapshotConstPtr snapshot = state_publisher_->getSnapshot();
+  if (snapshot->version != cached_joint_table_version_) {
+    // the cache was indexed by the previous joint table
+    resetJointTable(*snapshot);
+    return;
+  }
+
+  ros::Time now = ros::Time::now();
+  ros::Time stamp;
+  bool any = false;
+  joint_positions_.assign(cached_num_joints_, 0.0);
+  joint_valid_.assign(cached_num_joints_, 0);
+  aggregate_batch_stamp_.assign(cached_num_joints_, ros::Time());
+  for (size_t i = 0; i < cached_num_joints_; ++i) {
+    if (!aggregate_pending_[i])  continue;
+    aggregate_pending_[i] = 0;
+    if (now - aggregate_received_[i] <= sources_[aggregate_source_[i]].max_age) {
+      joint_positions_[i] = aggregate_position_[i];
+      joint_valid_[i] = 1;
+      aggregate_batch_stamp_[i] = aggregate_stamp_[i];
+      if (!any || aggregate_stamp_[i] > stamp)  stamp = aggregate_stamp_[i];
+      any = true;
+    }
+  }
+  if (!any)  return;
+
+  // mimic joints that were not received take the stamp of the joint they copy
+  snapshot->getJointMimicPositions(joint_positions_, joint_valid_);
+  const std::vector<MimicJoint>& mimic_joints = snapshot->mimic_joints;
+  for (size_t i = 0; i < mimic_joints.size(); ++i) {
+    const MimicJoint& m = mimic_joints[i];
+    if (joint_valid_[m.dst] && aggregate_batch_stamp_[m.dst].isZero()) {
+      aggregate_batch_stamp_[m.dst] = aggregate_batch_stamp_[m.src];
+    }
+  }
+  // the keep-alive of the deadband runs on the newest stamp of the batch
+  if (applyDeadband(*snapshot, stamp)) {
+    state_publisher_->publishTransforms(*snapshot, joint_positions_, joint_valid_, aggregate_batch_stamp_);
+  }
+}
+
+// Drop joints from the batch that did not move by more than the deadband since
+// they were last sent, unless their keep-alive expired.  Returns whether any
+// joint is left to send.
+bool JointStateListener::applyDeadband(const KinematicSnapshot& snapshot, const ros::Time& stamp)
+{
+  bool any = false;
+  for (size_t i = 0; i < cached_num_joints_; ++i) {
+    if (!joint_valid_[i])  continue;
+    if (joint_deadband_ > 0.0 && !last_sent_time_[i].isZero() && stamp < last_sent_time_[i] + keep_alive_interval_) {
+      double moved = joint_positions_[i] - last_sent_position_[i];
+      if (snapshot.joint_continuous[i])  moved = std::remainder(moved, 2.0 * M_PI);
+      if (std::fabs(moved) <= joint_deadband_) {
+        joint_valid_[i] = 0;
+        continue;
+      }
+    }
+    last_sent_time_[i] = stamp;
+    last_sent_position_[i] = joint_positions_[i];
+    any = true;
+  }
+  return any;
+}
+
+// Find the cached ordering of a list of joint names, resolving and caching it
+// if it was not seen recently.  Steady state this hashes and compares the
+// names, without copying them or looking them up.
+JointStateListener::JointOrdering& JointStateListener::findJointOrdering(
+    const KinematicSnapshot& snapshot, const std::vector<std::string>& names, const ros::Time& now)
+{
+  static const size_t cache_size = 4;
+  const size_t hash = boost::hash_range(names.begin(), names.end());
+  JointOrdering* ordering = NULL;
+  for (size_t i = 0; i < joint_orderings_.size() && !ordering; ++i) {
+    if (joint_orderings_[i].hash == hash && joint_orderings_[i].names == names) {
+      ordering = &joint_orderings_[i];
+    }
+  }
+
+  bool stale = !ordering;
+  if (!ordering) {
+    // replace the least recently used ordering once the cache is full
+    if (joint_orderings_.size() < cache_size) {
+      joint_orderings_.push_back(JointOrdering());
+      ordering = &joint_orderings_.back();
+    }
+    else {
+      ordering = &joint_orderings_[0];
+      for (size_t i = 1; i < joint_orderings_.size(); ++i) {
+        if (joint_orderings_[i].used < ordering->used)  ordering = &joint_orderings_[i];
+      }
+    }
+    ordering->hash = hash;
+    ordering->names = names;
+    ordering->shared = false;
+    snapshot.getJointIndices(names, ordering->indices);
+
+    // An ordering that shares no joints is the only one to update their
+    // publish times.  Once shared, an ordering stays shared until the cache is
+    // cleared, so that its publish time is checked even after the ordering it
+    // shared joints with was evicted.
+    std::vector<unsigned int> orderings_per_joint(cached_num_joints_, 0);
+    for (size_t i = 0; i < joint_orderings_.size(); ++i) {
+      for (size_t j = 0; j < joint_orderings_[i].indices.size(); ++j) {
+        if (joint_orderings_[i].indices[j] >= 0)  ++orderings_per_joint[joint_orderings_[i].indices[j]];
+      }
+    }
+    for (size_t i = 0; i < joint_orderings_.size(); ++i) {
+      for (size_t j = 0; j < joint_orderings_[i].indices.size(); ++j) {
+        int idx = joint_orderings_[i].indices[j];
+        if (idx >= 0 && orderings_per_joint[idx] > 1)  joint_orderings_[i].shared = true;
+      }
+    }
+  }
+  // another ordering may have published some of this one's joints since
+  stale = stale || (ordering->shared && ordering->published != joint_ordering_publishes_);
+
+  if (stale) {
+    // determine the least recently published joint of the ordering; while
+    // no other ordering publishes its joints it is tracked as the last publish time
+    ordering->last_published = now;
+    for (size_t i = 0; i < ordering->indices.size(); ++i) {
+      int idx = ordering->indices[i];
+      if (idx >= 0 && last_publish_time_[idx] < ordering->last_published) {
+        ordering->last_published = last_publish_time_[idx];
+      }
+    }
+    // note: if a joint was seen for the first time,
+    //       then last_published is zero.
+    ordering->published = joint_ordering_publishes_;
+  }
+  ordering->used = ++joint_ordering_uses_;
+  return *ordering;
 }
 
 void JointStateListener::callbackJointState(const JointStateConstPtr& state)
 {
+  RSP_STATS(PipelineStats& stats = state_publisher_->getStats());
+  RSP_STATS(PipelineStats::TimePoint callback_start = PipelineStats::now());
+  RSP_STATS(stats.count(PipelineStats::RECEIVED));
+
   if (state->name.size() != state->position.size()){
+    RSP_STATS(stats.count(PipelineStats::INVALID));
     if (state->position.empty()){
       const int throttleSeconds = 300;
       ROS_WARN_THROTTLE(throttleSeconds,
@@ -127,73 +558,62 @@ void JointStateListener::callbackJointState(const JointStateConstPtr& state)
   if (last_callback_time_ > now) {
     // force re-publish of joint transforms
     ROS_WARN("Moved backwards in time (probably because ROS clock was reset), re-publishing joint transforms!");
-    last_publish_time_.clear();
+    last_publish_time_.assign(last_publish_time_.size(), ros::Time());
+    last_sent_time_.assign(last_sent_time_.size(), ros::Time());
+    for (size_t i = 0; i < joint_orderings_.size(); ++i) {
+      joint_orderings_[i].last_published = ros::Time();
+    }
   }
   ros::Duration warning_threshold(30.0);
   if ((state->header.stamp + warning_threshold) < now) {
     ROS_WARN_THROTTLE(10, "Received JointState is %f seconds old.", (now - state->header.stamp).toSec());
   }
   last_callback_time_ = now;
+  RSP_STATS(if (now >= state->header.stamp) stats.record(PipelineStats::MESSAGE_AGE, (now - state->header.stamp).toNSec()));
 
-  // determine least recently published joint
-  ros::Time last_published = now;
-  for (unsigned int i=0; i<state->name.size(); i++) {
-    ros::Time t = last_publish_time_[state->name[i]];
-    last_published = (t < last_published) ? t : last_published;
+  // Take the current kinematic snapshot; a concurrent URDF swap publishes a
+  // new one and never invalidates the one held here.
+  KinematicSnapshotConstPtr snapshot = state_publisher_->getSnapshot();
+
+  // resolve joint names to joint table indices, unless this ordering was seen recently
+  if (snapshot->version != cached_joint_table_version_) {
+    resetJointTable(*snapshot);
   }
-  // note: if a joint was seen for the first time,
-  //       then last_published is zero.
+  JointOrdering& ordering = findJointOrdering(*snapshot, state->name, now);
+  const std::vector<int>& joint_indices = ordering.indices;
+  ros::Time last_published = (ordering.last_published < now) ? ordering.last_published : now;
 
   // check if we need to publish
-  if (ignore_timestamp_ || state->header.stamp >= last_published + publish_interval_) {
-    // get joint positions from state message
-    map<string, double> joint_positions;
+  bool publish = ignore_timestamp_ || state->header.stamp >= last_published + publish_interval_;
+  RSP_STATS(PipelineStats::TimePoint stage_start = stats.record(PipelineStats::THROTTLE, callback_start));
+  RSP_STATS(if (!publish) stats.count(PipelineStats::THROTTLED));
+  if (publish) {
+    // get joint positions from state message; the buffers only reallocate when the joint table grows
+    joint_positions_.assign(cached_num_joints_, 0.0);
+    joint_valid_.assign(cached_num_joints_, 0);
     for (unsigned int i=0; i<state->name.size(); i++) {
-      joint_positions.insert(make_pair(state->name[i], state->position[i]));
+      int idx = joint_indices[i];
+      if (idx >= 0 && !joint_valid_[idx]) {
+        joint_positions_[idx] = state->position[i];
+        joint_valid_[idx] = 1;
+      }
     }
+    RSP_STATS(stage_start = stats.record(PipelineStats::CONVERT, stage_start));
 
-    if(!state_publisher_.getJointMimicPositions(joint_positions))
-    {
-      ROS_WARN("Failed to update mimic joint transforms due to URDF update.");
-    }
+    snapshot->getJointMimicPositions(joint_positions_, joint_valid_);
+    RSP_STATS(stats.record(PipelineStats::MIMIC, stage_start));
 
-    state_publisher_.publishTransforms(joint_positions, state->header.stamp);
-
-    // store publish time in joint map
-    for (unsigned int i = 0; i<state->name.size(); i++) {
-      last_publish_time_[state->name[i]] = state->header.stamp;
+    if (applyDeadband(*snapshot, state->header.stamp)) {
+      state_publisher_->publishTransforms(*snapshot, joint_positions_, joint_valid_, state->header.stamp);
     }
-  }
-}
 
-// ----------------------------------
-// ----- MAIN -----------------------
-// ----------------------------------
-int main(int argc, char** argv)
-{
-  // Initialize ros
-  ros::init(argc, argv, "robot_state_publisher");
-  NodeHandle node;
-
-  ///////////////////////////////////////// begin deprecation warning
-  std::string exe_name = argv[0];
-  std::size_t slash = exe_name.find_last_of("/");
-  if (slash != std::string::npos) {
-    exe_name = exe_name.substr(slash + 1);
-  }
-  if (exe_name == "state_publisher") {
-    ROS_WARN("The 'state_publisher' executable is deprecated. Please use 'robot_state_publisher' instead");
+    // store publish time per joint; all joints of this ordering now share it
+    for (unsigned int i = 0; i<joint_indices.size(); i++) {
+      int idx = joint_indices[i];
+      if (idx >= 0)  last_publish_time_[idx] = state->header.stamp;
+    }
+    ordering.last_published = state->header.stamp;
+    ordering.published = ++joint_ordering_publishes_;
   }
-  ///////////////////////////////////////// end deprecation warning
-
-  // gets the location of the robot description on the parameter server
-  urdf::Model model;
-  if (!model.initParam("robot_base_description"))
-    return -1;
-
-  JointStateListener state_publisher(model);
-  state_publisher.init();
-  ros::spin();
-
-  return 0;
+  RSP_STATS(stats.record(PipelineStats::CALLBACK, callback_start));
 }
@@ -0,0 +1,380 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// kinematic_cache.cpp
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/ros.h>
+
+#include "robot_state_publisher/kinematic_cache.h"
+
+namespace robot_state_publisher {
+
+namespace {
+
+const char MAGIC[4] = { 'R', 'S', 'P', 'K' };
+
+// 64 bit FNV-1a; unlike std::hash it is the same in every build.
+class Hash
+{
+public:
+  Hash() : value_(14695981039346656037ULL) {}
+
+  void add(const void* data, size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      value_ = (value_ ^ bytes[i]) * 1099511628211ULL;
+    }
+  }
+  void add(uint64_t value) { add(&value, sizeof(value)); }
+  void add(const std::string& text) { add(static_cast<uint64_t>(text.size())); add(text.data(), text.size()); }
+
+  uint64_t value() const { return value_; }
+
+private:
+  uint64_t value_;
+};
+
+class Writer
+{
+public:
+  void raw(const void* data, size_t size) { buffer.append(static_cast<const char*>(data), size); }
+  void u32(uint32_t value) { raw(&value, sizeof(value)); }
+  void f64(double value) { raw(&value, sizeof(value)); }
+  void str(const std::string& text) { u32(static_cast<uint32_t>(text.size())); raw(text.data(), text.size()); }
+
+  void frame(const KDL::Frame& frame)
+  {
+    for (int i = 0; i < 9; ++i)  f64(frame.M.data[i]);
+    for (int i = 0; i < 3; ++i)  f64(frame.p.data[i]);
+  }
+  void vector(const KDL::Vector& vector)
+  {
+    for (int i = 0; i < 3; ++i)  f64(vector(i));
+  }
+
+  void segment(const SegmentPair& pair)
+  {
+    const KDL::Joint& joint = pair.segment.getJoint();
+    str(pair.root);
+    str(pair.tip);
+    str(pair.segment.getName());
+    str(joint.getName());
+    u32(static_cast<uint32_t>(joint.getType()));
+    vector(joint.JointOrigin());
+    vector(joint.JointAxis());
+    frame(pair.segment.getFrameToTip());
+  }
+
+  void transform(const geometry_msgs::TransformStamped& transform)
+  {
+    str(transform.header.frame_id);
+    str(transform.child_frame_id);
+    const geometry_msgs::Transform& t = transform.transform;
+    f64(t.translation.x);  f64(t.translation.y);  f64(t.translation.z);
+    f64(t.rotation.x);  f64(t.rotation.y);  f64(t.rotation.z);  f64(t.rotation.w);
+  }
+
+  std::string buffer;
+};
+
+// Reads from the mapped file; once anything runs past the end, every read
+// fails and returns zeros.
+class Reader
+{
+public:
+  Reader(const char* begin, const char* end) : pos_(begin), end_(end), ok_(true) {}
+
+  bool ok() const { return ok_; }
+
+  bool raw(void* data, size_t size)
+  {
+    if (!ok_ || static_cast<size_t>(end_ - pos_) < size) {
+      ok_ = false;
+      memset(data, 0, size);
+      return false;
+    }
+    memcpy(data, pos_, size);
+    pos_ += size;
+    return true;
+  }
+  uint32_t u32() { uint32_t value; raw(&value, sizeof(value)); return value; }
+  double f64() { double value; raw(&value, sizeof(value)); return value; }
+  std::string str()
+  {
+    uint32_t size = u32();
+    if (!ok_ || static_cast<size_t>(end_ - pos_) < size) {
+      ok_ = false;
+      return std::string();
+    }
+    std::string text(pos_, size);
+    pos_ += size;
+    return text;
+  }
+
+  KDL::Frame frame()
+  {
+    KDL::Frame frame;
+    for (int i = 0; i < 9; ++i)  frame.M.data[i] = f64();
+    for (int i = 0; i < 3; ++i)  frame.p.data[i] = f64();
+    return frame;
+  }
+  KDL::Vector vector()
+  {
+    double x = f64(), y = f64(), z = f64();
+    return KDL::Vector(x, y, z);
+  }
+
+  SegmentPair segment()
+  {
+    std::string root = str(), tip = str(), name = str(), joint_name = str();
+    uint32_t type = u32();
+    KDL::Vector origin = vector(), axis = vector();
+    KDL::Frame frame_to_tip = frame();
+    if (type > KDL::Joint::None) {
+      ok_ = false;
+      type = KDL::Joint::None;
+    }
+    KDL::Joint::JointType joint_type = static_cast<KDL::Joint::JointType>(type);
+    KDL::Joint joint = (joint_type == KDL::Joint::RotAxis || joint_type == KDL::Joint::TransAxis) ?
+        KDL::Joint(joint_name, origin, axis, joint_type) : KDL::Joint(joint_name, joint_type);
+    return SegmentPair(KDL::Segment(name, joint, frame_to_tip), root, tip);
+  }
+
+  geometry_msgs::TransformStamped transform()
+  {
+    geometry_msgs::TransformStamped transform;
+    transform.header.frame_id = str();
+    transform.child_frame_id = str();
+    geometry_msgs::Transform& t = transform.transform;
+    t.translation.x = f64();  t.translation.y = f64();  t.translation.z = f64();
+    t.rotation.x = f64();  t.rotation.y = f64();  t.rotation.z = f64();  t.rotation.w = f64();
+    return transform;
+  }
+
+private:
+  const char* pos_;
+  const char* end_;
+  bool ok_;
+};
+
+struct Header
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t size;      // Bytes following the header
+};
+
+bool decode(Reader& in, KinematicSnapshot& snapshot)
+{
+  uint32_t joints = in.u32();
+  for (uint32_t i = 0; i < joints && in.ok(); ++i) {
+    SegmentPair pair = in.segment();
+    geometry_msgs::TransformStamped transform;
+    transform.header.frame_id = in.str();
+    transform.child_frame_id = in.str();
+    char continuous = static_cast<char>(in.u32());
+    snapshot.frame_ids.insert(std::make_pair(pair.root, transform.header.frame_id));
+    snapshot.frame_ids.insert(std::make_pair(pair.tip, transform.child_frame_id));
+    snapshot.joint_index.insert(std::make_pair(pair.segment.getJoint().getName(), static_cast<int>(i)));
+    snapshot.joint_segments.push_back(pair);
+    snapshot.joint_transforms.push_back(transform);
+    snapshot.joint_continuous.push_back(continuous);
+  }
+
+  uint32_t fixed = in.u32();
+  for (uint32_t i = 0; i < fixed && in.ok(); ++i) {
+    std::string joint_name = in.str();
+    SegmentPair pair = in.segment();
+    snapshot.segments_fixed.insert(std::make_pair(joint_name, pair));
+    snapshot.fixed_transforms.push_back(in.transform());
+    snapshot.frame_ids.insert(std::make_pair(pair.root, snapshot.fixed_transforms.back().header.frame_id));
+    snapshot.frame_ids.insert(std::make_pair(pair.tip, snapshot.fixed_transforms.back().child_frame_id));
+  }
+
+  uint32_t mimics = in.u32();
+  for (uint32_t i = 0; i < mimics && in.ok(); ++i) {
+    std::string name = in.str();
+    std::shared_ptr<urdf::JointMimic> mimic(new urdf::JointMimic());
+    mimic->joint_name = in.str();
+    mimic->multiplier = in.f64();
+    mimic->offset = in.f64();
+    snapshot.mimic.insert(std::make_pair(name, mimic));
+  }
+  snapshot.compileMimicJoints();
+  return in.ok();
+}
+
+}  // namespace
+
+uint64_t KinematicCache::key(const std::string& urdf, const std::vector<std::string>& fragments,
+                             const std::string& tf_prefix)
+{
+  Hash hash;
+  hash.add(FORMAT_VERSION);
+  hash.add(urdf);
+  hash.add(static_cast<uint64_t>(fragments.size()));
+  for (size_t i = 0; i < fragments.size(); ++i) {
+    hash.add(fragments[i]);
+  }
+  hash.add(tf_prefix);
+  return hash.value();
+}
+
+std::string KinematicCache::file(const std::string& directory, uint64_t key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.rspk", static_cast<unsigned long long>(key));
+  return directory + "/" + name;
+}
+
+KinematicSnapshotPtr KinematicCache::load(const std::string& file, uint64_t key)
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)  return KinematicSnapshotPtr();
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return KinematicSnapshotPtr();
+  }
+  size_t size = st.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)  return KinematicSnapshotPtr();
+
+  const char* data = static_cast<const char*>(mapped);
+  Header header;
+  memcpy(&header, data, sizeof(header));
+  KinematicSnapshotPtr snapshot;
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == FORMAT_VERSION &&
+      header.key == key && header.size == size - sizeof(Header)) {
+    snapshot.reset(new KinematicSnapshot());
+    Reader in(data + sizeof(Header), data + size);
+    if (!decode(in, *snapshot)) {
+      ROS_WARN("robot_state_publisher: ignoring damaged kinematic cache %s", file.c_str());
+      snapshot.reset();
+    }
+  }
+  munmap(mapped, size);
+  return snapshot;
+}
+
+bool KinematicCache::save(const std::string& file, uint64_t key, const KinematicSnapshot& snapshot)
+{
+  Writer out;
+  out.u32(static_cast<uint32_t>(snapshot.joint_segments.size()));
+  for (size_t i = 0; i < snapshot.joint_segments.size(); ++i) {
+    out.segment(snapshot.joint_segments[i]);
+    out.str(snapshot.joint_transforms[i].header.frame_id);
+    out.str(snapshot.joint_transforms[i].child_frame_id);
+    out.u32(snapshot.joint_continuous[i]);
+  }
+
+  // fixed transforms are stored in publishing order, each with its segment,
+  // found by the child frame id: the tip, possibly behind a tf prefix
+  std::vector<const std::pair<const std::string, SegmentPair>*> fixed;
+  for (size_t i = 0; i < snapshot.fixed_transforms.size(); ++i) {
+    const std::string& child = snapshot.fixed_transforms[i].child_frame_id;
+    for (std::map<std::string, SegmentPair>::const_iterator s = snapshot.segments_fixed.begin();
+         s != snapshot.segments_fixed.end(); ++s) {
+      std::string tip = (!s->second.tip.empty() && s->second.tip[0] == '/') ? s->second.tip.substr(1) : s->second.tip;
+      if (child == tip || (child.size() > tip.size() && child[child.size() - tip.size() - 1] == '/' &&
+                           child.compare(child.size() - tip.size(), std::string::npos, tip) == 0)) {
+        fixed.push_back(&*s);
+        break;
+      }
+    }
+  }
+  if (fixed.size() != snapshot.fixed_transforms.size()) {
+    ROS_WARN("robot_state_publisher: not caching a snapshot whose fixed transforms do not match its segments");
+    return false;
+  }
+  out.u32(static_cast<uint32_t>(fixed.size()));
+  for (size_t i = 0; i < fixed.size(); ++i) {
+    out.str(fixed[i]->first);
+    out.segment(fixed[i]->second);
+    out.transform(snapshot.fixed_transforms[i]);
+  }
+
+  out.u32(static_cast<uint32_t>(snapshot.mimic.size()));
+  for (MimicMap::const_iterator m = snapshot.mimic.begin(); m != snapshot.mimic.end(); ++m) {
+    out.str(m->first);
+    out.str(m->second->joint_name);
+    out.f64(m->second->multiplier);
+    out.f64(m->second->offset);
+  }
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.key = key;
+  header.size = out.buffer.size();
+
+  size_t slash = file.rfind('/');
+  if (slash != std::string::npos && slash > 0) {
+    if (mkdir(file.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) {
+      ROS_WARN("robot_state_publisher: could not create the kinematic cache directory for %s: %s",
+               file.c_str(), strerror(errno));
+      return false;
+    }
+  }
+  // write to a temporary file and rename it, so that readers never see a partial file
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", static_cast<int>(getpid()));
+  std::string temporary = file + suffix;
+  {
+    std::ofstream stream(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(out.buffer.data(), out.buffer.size());
+    if (!stream) {
+      ROS_WARN("robot_state_publisher: could not write the kinematic cache %s", temporary.c_str());
+      unlink(temporary.c_str());
+      return false;
+    }
+  }
+  if (rename(temporary.c_str(), file.c_str()) != 0) {
+    ROS_WARN("robot_state_publisher: could not replace the kinematic cache %s: %s", file.c_str(), strerror(errno));
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,121 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// pipeline_stats.cpp
+
+#include <cstdio>
+#include <string>
+
+#include "robot_state_publisher/pipeline_stats.h"
+
+namespace robot_state_publisher {
+
+LatencyHistogram::LatencyHistogram()
+  : count_(0), sum_(0), max_(0)
+{
+  for (int i = 0; i < BUCKETS; ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+double LatencyHistogram::mean() const
+{
+  uint64_t n = count();
+  return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+  uint64_t n = count();
+  if (!n)  return 0;
+  uint64_t target = static_cast<uint64_t>(fraction * n);
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen > target)  return (uint64_t(2) << i) - 1;
+  }
+  return max();
+}
+
+PipelineStats::PipelineStats()
+{
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    counters_[i] = 0;
+  }
+}
+
+const char* PipelineStats::stageName(Stage stage)
+{
+  static const char* names[NUM_STAGES] = {
+    "message_age", "throttle", "convert", "mimic", "transforms", "send", "callback"
+  };
+  return names[stage];
+}
+
+const char* PipelineStats::counterName(Counter counter)
+{
+  static const char* names[NUM_COUNTERS] = { "received", "invalid", "throttled", "overflowed", "superseded" };
+  return names[counter];
+}
+
+static void addCount(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, uint64_t value)
+{
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = std::to_string(value);
+  status.values.push_back(kv);
+}
+
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.1f", value);
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = buffer;
+  status.values.push_back(kv);
+}
+
+void PipelineStats::toDiagnostic(diagnostic_msgs::DiagnosticStatus& status) const
+{
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    addCount(status, counterName(static_cast<Counter>(i)), counter(static_cast<Counter>(i)));
+  }
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    const LatencyHistogram& h = stages_[i];
+    const std::string name = stageName(static_cast<Stage>(i));
+    addCount(status, name + " count", h.count());
+    addValue(status, name + " mean us", h.mean() / 1000.0);
+    addValue(status, name + " p50 us", h.percentile(0.5) / 1000.0);
+    addValue(status, name + " p99 us", h.percentile(0.99) / 1000.0);
+    addValue(status, name + " max us", h.max() / 1000.0);
+  }
+}
+
+}
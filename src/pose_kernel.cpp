@@ -0,0 +1,227 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+// pose_kernel.cpp
+// Closed-form segment poses, specialized by joint type when the table is built.
+
+#include <cmath>
+
+#include "robot_state_publisher/pose_kernel.h"
+
+namespace robot_state_publisher {
+
+namespace {
+
+// Below this, a component of the axis in the tip frame is taken to be zero.
+const double AXIS_EPSILON = 1e-12;
+// How closely a kernel has to reproduce its segment to be used.
+const double POSE_EPSILON = 1e-10;
+
+KDL::Rotation fromColumns(const double x[3], const double y[3], const double z[3])
+{
+  return KDL::Rotation(x[0], y[0], z[0],
+                       x[1], y[1], z[1],
+                       x[2], y[2], z[2]);
+}
+
+}
+
+PoseKernel::PoseKernel(const KDL::Segment& segment)
+  : kind_(GENERIC), sign_(1.0), offset_(false)
+{
+  const KDL::Joint& joint = segment.getJoint();
+  tip_ = segment.pose(0);
+  tip_.M.GetQuaternion(tip_quaternion_[0], tip_quaternion_[1], tip_quaternion_[2], tip_quaternion_[3]);
+  axis_ = joint.JointAxis();
+  axis_.Normalize();
+  origin_ = joint.JointOrigin();
+
+  switch (joint.getType()) {
+  case KDL::Joint::None:
+    kind_ = FIXED;
+    return;
+  case KDL::Joint::RotAxis: case KDL::Joint::RotX: case KDL::Joint::RotY: case KDL::Joint::RotZ:
+    kind_ = ROTATION;
+    break;
+  case KDL::Joint::TransAxis: case KDL::Joint::TransX: case KDL::Joint::TransY: case KDL::Joint::TransZ:
+    kind_ = TRANSLATION;
+    break;
+  default:
+    return;
+  }
+
+  if (kind_ == ROTATION) {
+    // Rot(axis, q) * M == M * Rot(M^T * axis, q), so a joint axis along an
+    // axis of the tip frame only mixes two columns of the tip rotation.
+    const KDL::Rotation& M = tip_.M;
+    double local_axis[3];
+    for (int j = 0; j < 3; ++j) {
+      local_axis[j] = M(0, j) * axis_(0) + M(1, j) * axis_(1) + M(2, j) * axis_(2);
+    }
+    for (int j = 0; j < 3; ++j) {
+      if (std::fabs(local_axis[(j + 1) % 3]) < AXIS_EPSILON && std::fabs(local_axis[(j + 2) % 3]) < AXIS_EPSILON) {
+        kind_ = static_cast<Kind>(ROTATION_X + j);
+        sign_ = local_axis[j] < 0 ? -1.0 : 1.0;
+        local_axis[j] = sign_;
+        local_axis[(j + 1) % 3] = local_axis[(j + 2) % 3] = 0.0;
+      }
+    }
+    local_axis_ = KDL::Vector(local_axis[0], local_axis[1], local_axis[2]);
+
+    // kdl_parser puts the joint origin at the tip, which keeps the tip on the axis.
+    KDL::Vector offset = tip_.p - origin_;
+    offset_ = offset(0) != 0.0 || offset(1) != 0.0 || offset(2) != 0.0;
+    for (int j = 0; j < 3; ++j) {
+      local_(j) = M(0, j) * offset(0) + M(1, j) * offset(1) + M(2, j) * offset(2);
+    }
+  }
+
+  // The closed forms assume the unit scale and zero offset kdl_parser gives
+  // every joint; anything else is evaluated through Segment::pose().
+  const double samples[] = { 0.5, -2.0, 3.0 };
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+    if (!KDL::Equal(segment.pose(samples[i]), pose(segment, samples[i]), POSE_EPSILON)) {
+      kind_ = GENERIC;
+      break;
+    }
+  }
+}
+
+KDL::Frame PoseKernel::pose(const KDL::Segment& segment, double q) const
+{
+  const KDL::Rotation& M = tip_.M;
+  switch (kind_) {
+  case FIXED:
+    return tip_;
+
+  case TRANSLATION:
+    return KDL::Frame(M, tip_.p + axis_ * q);
+
+  case ROTATION: {
+    KDL::Rotation r = KDL::Rotation::Rot2(axis_, q);
+    return KDL::Frame(r * M, offset_ ? origin_ + r * (tip_.p - origin_) : tip_.p);
+  }
+
+  case ROTATION_X: case ROTATION_Y: case ROTATION_Z: {
+    const double s = sign_ * std::sin(q);
+    const double c = std::cos(q);
+    double x[3], y[3], z[3];
+    // columns of M * RotX(q), M * RotY(q) or M * RotZ(q)
+    if (kind_ == ROTATION_X) {
+      for (int i = 0; i < 3; ++i) {
+        x[i] = M(i, 0);
+        y[i] = c * M(i, 1) + s * M(i, 2);
+        z[i] = c * M(i, 2) - s * M(i, 1);
+      }
+    }
+    else if (kind_ == ROTATION_Y) {
+      for (int i = 0; i < 3; ++i) {
+        x[i] = c * M(i, 0) - s * M(i, 2);
+        y[i] = M(i, 1);
+        z[i] = c * M(i, 2) + s * M(i, 0);
+      }
+    }
+    else {
+      for (int i = 0; i < 3; ++i) {
+        x[i] = c * M(i, 0) + s * M(i, 1);
+        y[i] = c * M(i, 1) - s * M(i, 0);
+        z[i] = M(i, 2);
+      }
+    }
+    KDL::Frame frame(fromColumns(x, y, z), tip_.p);
+    if (offset_) {
+      for (int i = 0; i < 3; ++i) {
+        frame.p(i) = origin_(i) + x[i] * local_(0) + y[i] * local_(1) + z[i] * local_(2);
+      }
+    }
+    return frame;
+  }
+
+  default:
+    return segment.pose(q);
+  }
+}
+
+void PoseKernel::transform(const KDL::Segment& segment, double q, geometry_msgs::Transform& transform) const
+{
+  const double* t = tip_quaternion_;
+  switch (kind_) {
+  case FIXED: case TRANSLATION: {
+    const KDL::Vector p = kind_ == FIXED ? tip_.p : tip_.p + axis_ * q;
+    transform.translation.x = p(0);
+    transform.translation.y = p(1);
+    transform.translation.z = p(2);
+    transform.rotation.x = t[0];
+    transform.rotation.y = t[1];
+    transform.rotation.z = t[2];
+    transform.rotation.w = t[3];
+    return;
+  }
+
+  case ROTATION_X: case ROTATION_Y: case ROTATION_Z: case ROTATION: {
+    // tip * joint, with the joint rotation (sin(q/2) * axis, cos(q/2)) in the tip frame
+    const double s = std::sin(0.5 * q);
+    const double c = std::cos(0.5 * q);
+    const double ax = s * local_axis_(0), ay = s * local_axis_(1), az = s * local_axis_(2);
+    const double x = t[3] * ax + c * t[0] + t[1] * az - t[2] * ay;
+    const double y = t[3] * ay + c * t[1] + t[2] * ax - t[0] * az;
+    const double z = t[3] * az + c * t[2] + t[0] * ay - t[1] * ax;
+    const double w = t[3] * c - t[0] * ax - t[1] * ay - t[2] * az;
+    transform.rotation.x = x;
+    transform.rotation.y = y;
+    transform.rotation.z = z;
+    transform.rotation.w = w;
+
+    if (!offset_) {
+      transform.translation.x = tip_.p(0);
+      transform.translation.y = tip_.p(1);
+      transform.translation.z = tip_.p(2);
+      return;
+    }
+    // origin + (x, y, z, w) * local, as v + 2w (u x v) + 2u x (u x v)
+    const double vx = local_(0), vy = local_(1), vz = local_(2);
+    const double cx = 2.0 * (y * vz - z * vy);
+    const double cy = 2.0 * (z * vx - x * vz);
+    const double cz = 2.0 * (x * vy - y * vx);
+    transform.translation.x = origin_(0) + vx + w * cx + (y * cz - z * cy);
+    transform.translation.y = origin_(1) + vy + w * cy + (z * cx - x * cz);
+    transform.translation.z = origin_(2) + vz + w * cz + (x * cy - y * cx);
+    return;
+  }
+
+  default: {
+    const KDL::Frame pose = segment.pose(q);
+    transform.translation.x = pose.p(0);
+    transform.translation.y = pose.p(1);
+    transform.translation.z = pose.p(2);
+    pose.M.GetQuaternion(transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w);
+  }
+  }
+}
+
+}
@@ -33,6 +33,7 @@
 
 #include "robot_state_publisher/robot_kdl_tree.h"
 #include <kdl_parser/kdl_parser.hpp>
+#include <set>
 #include <string>
 
 namespace robot_kdl_tree {
@@ -50,28 +51,44 @@ RobotKDLTree::RobotKDLTree()
 
 bool RobotKDLTree::init()
 {
-  if (RobotURDF::init())
-  {
-    return initFromURDF();
-  }
-  return false;
+  return RobotURDF::init();
 }
 
 bool RobotKDLTree::init(const std::string & urdfParamName)
 {
-  if (RobotURDF::init(urdfParamName))
+  return RobotURDF::init(urdfParamName);
+}
+
+bool RobotKDLTree::initFromString(const std::string & urdfString)
+{
+  if (!RobotURDF::initFromString(urdfString))
   {
-    return initFromURDF();
+    return false;
   }
-  return false;
+  if (m_sharedModel)
+  {
+    // The tree was built along with the shared model.
+    m_valid = m_sharedModel->treeValid;
+    if (!m_valid)
+    {
+      ROS_ERROR("RobotKDLTree: Failed to create KDL tree from URDF model");
+      return false;
+    }
+    m_treeFg = KDLTreePtr(m_sharedModel, &m_sharedModel->tree);
+    m_treeBg = m_treeFg;
+    return true;
+  }
+  m_treeFg.reset(new KDL::Tree());
+  m_treeBg.reset(new KDL::Tree());
+  return initFromURDF();
 }
 
+// Build the tree once; the background tree starts out as a copy of it.
 bool RobotKDLTree::initFromURDF()
 {
   if (getTreeFromURDF())
   {
-    swap();
-    getTreeFromURDF();
+    *m_treeFg = *m_treeBg;
     return true;
   }
   return false;
@@ -102,9 +119,52 @@ bool RobotKDLTree::getTreeFromURDF()
 }
 
 
+// Copy a tree, leaving out the given segments and everything below them.
+static bool copyTree(const KDL::SegmentMap::const_iterator segment, const std::set<std::string> & pruned,
+                     KDL::Tree & out)
+{
+  const std::vector<KDL::SegmentMap::const_iterator>& children = GetTreeElementChildren(segment->second);
+  for (unsigned int i = 0; i < children.size(); i++)
+  {
+    if (pruned.count(children[i]->first))  continue;
+    if (!out.addSegment(GetTreeElementSegment(children[i]->second), segment->first) ||
+        !copyTree(children[i], pruned, out))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Apply the current fragment change to a tree which matches the previous URDF.
+// KDL trees cannot remove segments, so a pruned tree is copied without them;
+// added fragments are built on their own and attached to their parent link.
+bool RobotKDLTree::applyTreeChange(KDL::Tree & tree)
+{
+  const URDFFragment & previous = m_change.previous;
+  if (previous.grafted && !previous.links.empty())
+  {
+    std::set<std::string> pruned(previous.links.begin(), previous.links.end());
+    KDL::Tree kept(tree.getRootSegment()->first);
+    if (!copyTree(tree.getRootSegment(), pruned, kept))  return false;
+    tree = kept;
+  }
+  if (m_change.fragment)
+  {
+    KDL::Tree fragmentTree;
+    if (!kdl_parser::treeFromUrdfModel(*m_change.fragment, fragmentTree) ||
+        !tree.addTree(fragmentTree, m_urdfMap[m_change.key].parentLink))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool RobotKDLTree::onURDFChange(const std::string &link_name)
 {
   if (!RobotURDF::onURDFChange(link_name))  return false;
+  if (m_change.incremental && applyTreeChange(*m_treeBg))  return true;
   return getTreeFromURDF();
 }
 
@@ -114,4 +174,30 @@ void RobotKDLTree::onURDFSwap(const std::string &link_name)
   swap();
 }
 
+void RobotKDLTree::detachBackground()
+{
+  if (m_sharedModel && m_treeBg.get() == &m_sharedModel->tree)
+  {
+    m_treeBg.reset(new KDL::Tree(*m_treeBg));
+  }
+  RobotURDF::detachBackground();
+}
+
+bool RobotKDLTree::sharesModel() const
+{
+  return RobotURDF::sharesModel() ||
+      (m_sharedModel && (m_treeFg.get() == &m_sharedModel->tree || m_treeBg.get() == &m_sharedModel->tree));
+}
+
+bool RobotKDLTree::syncBackground()
+{
+  if (!RobotURDF::syncBackground())  return false;
+  if (m_change.incremental && applyTreeChange(*m_treeBg))  return true;
+
+  // Rebuild the tree without touching m_valid; the foreground is already current.
+  bool synced = kdl_parser::treeFromUrdfModel(*getUrdfBgPtr(), *m_treeBg);
+  if (!synced)  m_bgStale = true;
+  return synced;
+}
+
 }  // namespace robot_kdl_tree
@@ -34,73 +34,429 @@
 
 /* Author: Wim Meeussen */
 
+#include <algorithm>
 #include <kdl/frames_io.hpp>
 #include <geometry_msgs/TransformStamped.h>
 #include <tf2_kdl/tf2_kdl.h>
 #include <memory>
+#include <utility>
+#include <boost/functional/hash.hpp>
 #include "robot_state_publisher/robot_state_publisher.h"
+#include "robot_state_publisher/kinematic_cache.h"
 
 using namespace std;
 using namespace ros;
 
 namespace robot_state_publisher {
 
-RobotStatePublisher::RobotStatePublisher(const urdf::Model& model)
-    : initialized_(false), model_(model)
+std::string stripSlash(const std::string & in)
+{
+  if (in.size() && in[0] == '/')
+  {
+    return in.substr(1);
+  }
+  return in;
+}
+
+// A tf prefix without slashes at either end
+std::string stripPrefix(const std::string & tf_prefix)
+{
+  std::string prefix = stripSlash(tf_prefix);
+  while (!prefix.empty() && prefix[prefix.size() - 1] == '/')
+  {
+    prefix.erase(prefix.size() - 1);
+  }
+  return prefix;
+}
+
+std::string prefixFrameId(const std::string & tf_prefix, const std::string & link)
+{
+  return tf_prefix.empty() ? stripSlash(link) : tf_prefix + "/" + stripSlash(link);
+}
+
+// ----------------------------------------------------------------
+// KinematicSnapshot
+
+int KinematicSnapshot::getJointIndex(const std::string& name) const
+{
+  std::map<std::string, int>::const_iterator idx = joint_index.find(name);
+  return (idx != joint_index.end()) ? idx->second : -1;
+}
+
+void KinematicSnapshot::getJointIndices(const std::vector<std::string>& names, std::vector<int>& indices) const
+{
+  indices.resize(names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    indices[i] = getJointIndex(names[i]);
+    if (indices[i] < 0) {
+      ROS_WARN_THROTTLE(10, "Joint state with name: \"%s\" was received but not found in URDF", names[i].c_str());
+    }
+  }
+}
+
+void KinematicSnapshot::getJointMimicPositions(std::map<std::string, double>& joint_positions) const
+{
+  for (size_t i = 0; i < mimic_joints.size(); ++i) {
+    const MimicJoint& m = mimic_joints[i];
+    std::map<std::string, double>::const_iterator src = joint_positions.find(joint_segments[m.src].segment.getJoint().getName());
+    if (src != joint_positions.end()) {
+      joint_positions.insert(make_pair(joint_segments[m.dst].segment.getJoint().getName(), src->second * m.multiplier + m.offset));
+    }
+  }
+}
+
+void KinematicSnapshot::getJointMimicPositions(std::vector<double>& joint_positions, std::vector<char>& joint_valid) const
+{
+  // positions that were received are kept; the rest copy their source, if it is set
+  for (size_t i = 0; i < mimic_joints.size(); ++i) {
+    const MimicJoint& m = mimic_joints[i];
+    const bool copy = joint_valid[m.src] && !joint_valid[m.dst];
+    const double mimicked = joint_positions[m.src] * m.multiplier + m.offset;
+    joint_positions[m.dst] = copy ? mimicked : joint_positions[m.dst];
+    joint_valid[m.dst] |= joint_valid[m.src];
+  }
+}
+
+void KinematicSnapshot::compileMimicJoints()
+{
+  mimic_joints.clear();
+  std::vector<int> mimic_of(joint_segments.size(), -1);
+  for (MimicMap::const_iterator i = mimic.begin(); i != mimic.end(); ++i) {
+    MimicJoint m;
+    m.dst = getJointIndex(i->first);
+    m.src = getJointIndex(i->second->joint_name);
+    m.multiplier = i->second->multiplier;
+    m.offset = i->second->offset;
+    if (m.dst >= 0 && m.src >= 0) {
+      mimic_of[m.dst] = static_cast<int>(mimic_joints.size());
+      mimic_joints.push_back(m);
+    }
+  }
+
+  // order by the length of the chain each joint mimics through
+  std::vector<std::pair<size_t, size_t> > order;
+  for (size_t i = 0; i < mimic_joints.size(); ++i) {
+    size_t depth = 0;
+    for (int j = mimic_joints[i].src; mimic_of[j] >= 0 && depth <= mimic_joints.size(); j = mimic_joints[mimic_of[j]].src) {
+      ++depth;
+    }
+    if (depth > mimic_joints.size()) {
+      ROS_WARN("Joint \"%s\" is part of a mimic cycle and will not be mimicked",
+               joint_segments[mimic_joints[i].dst].segment.getJoint().getName().c_str());
+      continue;
+    }
+    order.push_back(std::make_pair(depth, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<MimicJoint> sorted;
+  sorted.reserve(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    sorted.push_back(mimic_joints[order[i].second]);
+  }
+  mimic_joints.swap(sorted);
+}
+
+// ----------------------------------------------------------------
+// RobotStatePublisher
+
+RobotStatePublisher::RobotStatePublisher()
+    : snapshot_(new KinematicSnapshot()), snapshot_count_(0), fixed_tf_version_(0), prefixed_fixed_tf_version_(0),
+      next_shared_tf_batch_(0), publish_shared_messages_(false),
+      next_shared_tf_message_(0), model_deferred_(false), model_cache_size_(0), initialized_(false),
+      urdf_changed_(false)
 {
-  setJointMimicMap(model);
 }
 
 
   bool RobotStatePublisher::init()
   {
-    if (RobotKDLTree::init())
+    if (!static_tf_broadcaster_)
     {
-      // walk the tree and add segments to segments_
-      addChildren(getTree().getRootSegment());
-      initialized_ = true;
+      // same topic and queue size as tf2_ros::TransformBroadcaster
+      ros::NodeHandle n;
+      tf_pub_ = n.advertise<tf2_msgs::TFMessage>("/tf", 100);
+      static_tf_broadcaster_ = SharedStaticBroadcaster::acquire();
     }
 
+    // loads the URDF and calls initFromString
+    RobotKDLTree::init();
+
     if (!initialized_)  ROS_ERROR("robot_state_publisher:  failed to initialize!");
     return initialized_;
   }
 
+  bool RobotStatePublisher::initFromString(const std::string &urdf_string)
+  {
+    uint64_t cache_key = 0;
+    std::string cache_file;
+    if (!kinematic_cache_dir_.empty())
+    {
+      std::vector<std::string> fragments;
+      for (URDFFragmentMap::const_iterator fragment = m_urdfMap.begin(); fragment != m_urdfMap.end(); ++fragment)
+      {
+        fragments.push_back(fragment->first);
+        fragments.push_back(fragment->second.xml);
+      }
+      cache_key = KinematicCache::key(urdf_string, fragments, tf_prefix_);
+      cache_file = KinematicCache::file(kinematic_cache_dir_, cache_key);
+      KinematicSnapshotPtr cached = KinematicCache::load(cache_file, cache_key);
+      if (cached)
+      {
+        // publish right away; the URDF is parsed once something needs the model
+        ROS_INFO("robot_state_publisher: loaded the kinematic model from %s", cache_file.c_str());
+        cached->version = ++snapshot_count_;
+        boost::atomic_store(&snapshot_, KinematicSnapshotConstPtr(cached));
+        {
+          boost::mutex::scoped_lock lock(deferred_urdf_mtx_);
+          deferred_urdf_ = urdf_string;
+          model_deferred_.store(true, std::memory_order_release);
+        }
+        m_valid = true;
+        initialized_ = true;
+        return initialized_;
+      }
+    }
+
+    if (RobotKDLTree::initFromString(urdf_string))
+    {
+      // walk the tree and add segments to the joint table
+      KinematicSnapshotPtr snapshot = buildSnapshot(getTree(), *getUrdfPtr());
+      boost::atomic_store(&snapshot_, KinematicSnapshotConstPtr(snapshot));
+      initialized_ = true;
+      if (!cache_file.empty() && KinematicCache::save(cache_file, cache_key, *snapshot))
+      {
+        ROS_INFO("robot_state_publisher: saved the kinematic model to %s", cache_file.c_str());
+      }
+    }
+    return initialized_;
+  }
+
+  void RobotStatePublisher::ensureModel()
+  {
+    // called by every getUrdfPtr() and getTree(); only locks while a description is deferred
+    if (!model_deferred_.load(std::memory_order_acquire))  return;
+    boost::mutex::scoped_lock lock(deferred_urdf_mtx_);
+    if (deferred_urdf_.empty())  return;
+    // the snapshot is already current; only the model and tree are missing
+    if (!RobotKDLTree::initFromString(deferred_urdf_))
+    {
+      ROS_ERROR("robot_state_publisher: could not parse the URDF whose kinematic model was cached");
+    }
+    std::string().swap(deferred_urdf_);
+    model_deferred_.store(false, std::memory_order_release);
+  }
+
+  void RobotStatePublisher::setTfPrefix(const std::string& tf_prefix)
+  {
+    tf_prefix_ = stripPrefix(tf_prefix);
+  }
+
+  std::string RobotStatePublisher::frameId(const std::string& link) const
+  {
+    return prefixFrameId(tf_prefix_, link);
+  }
+
+  const std::string& RobotStatePublisher::internFrameId(const std::string& link, KinematicSnapshot& snapshot) const
+  {
+    std::map<std::string, std::string>::iterator id = snapshot.frame_ids.lower_bound(link);
+    if (id == snapshot.frame_ids.end() || id->first != link) {
+      id = snapshot.frame_ids.insert(id, make_pair(link, frameId(link)));
+    }
+    return id->second;
+  }
+
   void RobotStatePublisher::setJointMimicMap(const urdf::Model& model)
   {
     ROS_DEBUG("robot_state_publisher: Updating MimicMap.");
-    // get exclusive access for writing
-    boost::unique_lock<boost::shared_mutex> lock(mimic_mtx_);
-    mimic_.clear();
+    // copy the current snapshot and replace its mimic map
+    KinematicSnapshotConstPtr current = getSnapshot();
+    KinematicSnapshotPtr snapshot(current ? new KinematicSnapshot(*current) : new KinematicSnapshot());
+    snapshot->mimic.clear();
     for(std::map< std::string, std::shared_ptr< urdf::Joint > >::const_iterator i = model.joints_.begin(); i != model.joints_.end(); i++){
       if(i->second->mimic){
-        mimic_.insert(make_pair(i->first, i->second->mimic));
+        snapshot->mimic.insert(make_pair(i->first, i->second->mimic));
       }
     }
+    snapshot->compileMimicJoints();
+    snapshot->version = ++snapshot_count_;
+    boost::atomic_store(&snapshot_, KinematicSnapshotConstPtr(snapshot));
   }
 
   bool RobotStatePublisher::getJointMimicPositions(std::map<std::string, double>& joint_positions)
   {
-    // get shared access for reading
-    boost::shared_lock<boost::shared_mutex> lock(mimic_mtx_, boost::try_to_lock);
-    if (!lock.owns_lock())
-    {
-      ROS_DEBUG("robot_state_publisher: Failed to update positions for Mimic joints -- could not get lock");
+    getSnapshot()->getJointMimicPositions(joint_positions);
+    return true;
+  }
+
+  KinematicSnapshotPtr RobotStatePublisher::buildSnapshot(const KDL::Tree& tree, const urdf::Model& model)
+  {
+    KinematicSnapshotPtr snapshot(new KinematicSnapshot());
+    addChildren(tree.getRootSegment(), model, *snapshot);
+    for(std::map< std::string, std::shared_ptr< urdf::Joint > >::const_iterator i = model.joints_.begin(); i != model.joints_.end(); i++){
+      if(i->second->mimic){
+        snapshot->mimic.insert(make_pair(i->first, i->second->mimic));
+      }
+    }
+    snapshot->compileMimicJoints();
+    snapshot->version = ++snapshot_count_;
+    return snapshot;
+  }
+
+  /** This is called whenever a segment changes.
+   *  When that happens, rebuild all of the tf segments into a new snapshot
+   *  from the background tree.  For efficiency it should be possible to
+   *  find and rebuild only the relevant segment, but in practice the URDF
+   *  doesn't change very often.
+   */
+  bool RobotStatePublisher::onURDFChange(const std::string &link_name)
+  {
+    if (initialized_ && restoreCachedModel())  return true;
+
+    detachCachedBackground();
+    if (!RobotKDLTree::onURDFChange(link_name))  return false;
+    if (!initialized_)  return true;
+
+    RobotURDF::ConstUrdfPtr urdf_ptr = getUrdfBgPtr();
+    if(!urdf_ptr){
+      ROS_ERROR("robot_state_publisher: failed retrieve Robot Model for updating the kinematic snapshot!");
       return false;
     }
-    for(MimicMap::const_iterator i = mimic_.begin(); i != mimic_.end(); i++){
-      if(joint_positions.find(i->second->joint_name) != joint_positions.end()){
-        double pos = joint_positions[i->second->joint_name] * i->second->multiplier + i->second->offset;
-        joint_positions.insert(make_pair(i->first, pos));
+    next_snapshot_ = buildSnapshot(getBgTree(), *urdf_ptr);
+    cacheModel();
+    return true;
+  }
+
+  /** When the new foreground is held by the model cache, the background
+   *  shares it rather than replaying the change; the next change copies it.
+   */
+  bool RobotStatePublisher::syncBackground()
+  {
+    for (std::list<CachedModel>::const_iterator cached = model_cache_.begin(); cached != model_cache_.end(); ++cached)
+    {
+      if (m_urdfPtrFg == cached->model && m_treeFg == cached->tree)
+      {
+        m_urdfPtrBg = m_urdfPtrFg;
+        m_treeBg = m_treeFg;
+        m_bgStale = false;
+        return true;
       }
     }
-    return true;
+    detachCachedBackground();
+    return RobotKDLTree::syncBackground();
   }
 
-  /** This is called whenever a segment changes.
-   *  When that happens, rebuild all of the tf segments.
-   *  For efficiency it should be possible to find and rebuild only
-   *  the relevant segment, but in practice the URDF doesn't change
-   *  very often.
+  void RobotStatePublisher::setModelCacheSize(size_t size)
+  {
+    model_cache_size_ = size;
+    if (model_cache_.size() > size)
+    {
+      model_cache_.resize(size);
+    }
+  }
+
+  size_t RobotStatePublisher::fragmentSetKey() const
+  {
+    size_t key = 0;
+    for (URDFFragmentMap::const_iterator fragment = m_urdfMap.begin(); fragment != m_urdfMap.end(); ++fragment)
+    {
+      if (fragment->second.xml.empty())  continue;
+      boost::hash_combine(key, fragment->first);
+      boost::hash_combine(key, fragment->second.parentLink);
+      boost::hash_combine(key, fragment->second.xml);
+    }
+    return key;
+  }
+
+  bool RobotStatePublisher::restoreCachedModel()
+  {
+    if (model_cache_.empty())  return false;
+    const size_t key = fragmentSetKey();
+    for (std::list<CachedModel>::iterator cached = model_cache_.begin(); cached != model_cache_.end(); ++cached)
+    {
+      if (cached->key != key || !sameFragments(cached->fragments, m_urdfMap))  continue;
+
+      // move it to the front and swap it in
+      model_cache_.splice(model_cache_.begin(), model_cache_, cached);
+      ROS_DEBUG("robot_state_publisher: restoring the model for %s from the cache", m_change.key.c_str());
+      for (URDFFragmentMap::iterator fragment = m_urdfMap.begin(); fragment != m_urdfMap.end(); ++fragment)
+      {
+        URDFFragmentMap::const_iterator built = cached->fragments.find(fragment->first);
+        if (built == cached->fragments.end())  continue;
+        fragment->second.grafted = built->second.grafted;
+        fragment->second.links = built->second.links;
+        fragment->second.joints = built->second.joints;
+      }
+      m_urdfDoc = cached->doc;
+      m_urdfPtrBg = cached->model;
+      m_treeBg = cached->tree;
+      next_snapshot_ = cached->snapshot;
+      m_change.fragment.reset();
+      m_change.incremental = false;
+      m_bgStale = false;
+      return true;
+    }
+    return false;
+  }
+
+  void RobotStatePublisher::cacheModel()
+  {
+    if (model_cache_size_ == 0)  return;
+    CachedModel cached;
+    cached.key = fragmentSetKey();
+    cached.fragments = m_urdfMap;
+    cached.doc = m_urdfDoc;
+    cached.model = m_urdfPtrBg;
+    cached.tree = m_treeBg;
+    cached.snapshot = next_snapshot_;
+    model_cache_.push_front(cached);
+    if (model_cache_.size() > model_cache_size_)
+    {
+      model_cache_.pop_back();
+    }
+  }
+
+  void RobotStatePublisher::detachCachedBackground()
+  {
+    // a background shared with the foreground may be held by the cache, or may have been evicted from it
+    bool cached_model = m_urdfPtrBg == m_urdfPtrFg;
+    bool cached_tree = m_treeBg == m_treeFg;
+    for (std::list<CachedModel>::const_iterator cached = model_cache_.begin(); cached != model_cache_.end(); ++cached)
+    {
+      cached_model = cached_model || m_urdfPtrBg == cached->model;
+      cached_tree = cached_tree || m_treeBg == cached->tree;
+    }
+    if (cached_model)
+    {
+      UrdfPtr copy(new urdf::Model());
+      cloneModel(*m_urdfPtrBg, *copy);
+      m_urdfPtrBg = copy;
+    }
+    if (cached_tree)
+    {
+      m_treeBg.reset(new KDL::Tree(*m_treeBg));
+    }
+  }
+
+  bool RobotStatePublisher::sameFragments(const URDFFragmentMap& a, const URDFFragmentMap& b)
+  {
+    URDFFragmentMap::const_iterator i = a.begin(), j = b.begin();
+    while (true)
+    {
+      while (i != a.end() && i->second.xml.empty())  ++i;
+      while (j != b.end() && j->second.xml.empty())  ++j;
+      if (i == a.end() || j == b.end())  return i == a.end() && j == b.end();
+      if (i->first != j->first || i->second.parentLink != j->second.parentLink || i->second.xml != j->second.xml)
+      {
+        return false;
+      }
+      ++i;
+      ++j;
+    }
+  }
+
+  /** Publish the snapshot built by onURDFChange.  Publishers pick it up
+   *  with their next message; they are never blocked by the swap.
    */
   void RobotStatePublisher::onURDFSwap(const std::string &link_name)
   {
@@ -108,17 +464,9 @@ RobotStatePublisher::RobotStatePublisher(const urdf::Model& model)
 
     RobotKDLTree::onURDFSwap(link_name);
 
-    // Regenerate the segments:
-    segments_fixed_.clear();
-    segments_.clear();
-    // walk the tree and add segments to segments_
-    addChildren(getTree().getRootSegment());
-    boost::shared_ptr<const urdf::Model> urdf_ptr = getUrdfPtr();
-    if(urdf_ptr){
-      setJointMimicMap(*urdf_ptr);
-    }
-    else{
-      ROS_ERROR("robot_state_publisher: failed retrieve Robot Model for updating joint MimicMap!");
+    if (next_snapshot_) {
+      boost::atomic_store(&snapshot_, KinematicSnapshotConstPtr(next_snapshot_));
+      next_snapshot_.reset();
     }
     urdf_changed_ = true;
   }
@@ -134,7 +482,8 @@ RobotStatePublisher::RobotStatePublisher(const urdf::Model& model)
   }
 
 // add children to correct maps
-void RobotStatePublisher::addChildren(const KDL::SegmentMap::const_iterator segment)
+void RobotStatePublisher::addChildren(const KDL::SegmentMap::const_iterator segment, const urdf::Model& model,
+                                      KinematicSnapshot& snapshot)
 {
   const std::string& root = GetTreeElementSegment(segment->second).getName();
 
@@ -143,90 +492,250 @@ void RobotStatePublisher::addChildren(const KDL::SegmentMap::const_iterator segm
     const KDL::Segment& child = GetTreeElementSegment(children[i]->second);
     SegmentPair s(GetTreeElementSegment(children[i]->second), root, child.getName());
     if (child.getJoint().getType() == KDL::Joint::None) {
-      if (model_.getJoint(child.getJoint().getName()) && model_.getJoint(child.getJoint().getName())->type == urdf::Joint::FLOATING) {
+      if (model.getJoint(child.getJoint().getName()) && model.getJoint(child.getJoint().getName())->type == urdf::Joint::FLOATING) {
         ROS_INFO("Floating joint. Not adding segment from %s to %s. This TF can not be published based on joint_states info", root.c_str(), child.getName().c_str());
       }
       else {
-        segments_fixed_.insert(make_pair(child.getJoint().getName(), s));
+        if (snapshot.segments_fixed.insert(make_pair(child.getJoint().getName(), s)).second) {
+          geometry_msgs::TransformStamped tf_transform = tf2::kdlToTransform(s.segment.pose(0));
+          tf_transform.header.frame_id = internFrameId(s.root, snapshot);
+          tf_transform.child_frame_id = internFrameId(s.tip, snapshot);
+          snapshot.fixed_transforms.push_back(tf_transform);
+        }
         ROS_DEBUG("Adding fixed segment from %s to %s", root.c_str(), child.getName().c_str());
       }
     }
     else {
-      segments_.insert(make_pair(child.getJoint().getName(), s));
+      if (snapshot.joint_index.insert(make_pair(child.getJoint().getName(), static_cast<int>(snapshot.joint_segments.size()))).second) {
+        snapshot.joint_segments.push_back(s);
+        geometry_msgs::TransformStamped tf_transform;
+        tf_transform.header.frame_id = internFrameId(s.root, snapshot);
+        tf_transform.child_frame_id = internFrameId(s.tip, snapshot);
+        snapshot.joint_transforms.push_back(tf_transform);
+        urdf::JointConstSharedPtr joint = model.getJoint(child.getJoint().getName());
+        snapshot.joint_continuous.push_back(joint && joint->type == urdf::Joint::CONTINUOUS);
+      }
       ROS_DEBUG("Adding moving segment from %s to %s", root.c_str(), child.getName().c_str());
     }
-    addChildren(children[i]);
-  }
-}
-
-std::string stripSlash(const std::string & in)
-{
-  if (in.size() && in[0] == '/')
-  {
-    return in.substr(1);
+    addChildren(children[i], model, snapshot);
   }
-  return in;
 }
 
 // publish moving transforms
 void RobotStatePublisher::publishTransforms(const map<string, double>& joint_positions, const Time& time)
 {
-  boost::unique_lock<boost::shared_mutex> lock(m_swapMutex, boost::try_to_lock);
-  if (!lock.owns_lock())
-  {
-    ROS_DEBUG("Publishing transforms for moving joints -- could not get lock");
-    return;
-  }
   ROS_DEBUG("Publishing transforms for moving joints");
-  std::vector<geometry_msgs::TransformStamped> tf_transforms;
+  KinematicSnapshotConstPtr snapshot = getSnapshot();
+  tf2_msgs::TFMessage tf_message;
 
   // loop over all joints
   for (map<string, double>::const_iterator jnt=joint_positions.begin(); jnt != joint_positions.end(); jnt++) {
-    std::map<std::string, SegmentPair>::const_iterator seg = segments_.find(jnt->first);
-    if (seg != segments_.end()) {
-      geometry_msgs::TransformStamped tf_transform = tf2::kdlToTransform(seg->second.segment.pose(jnt->second));
+    int idx = snapshot->getJointIndex(jnt->first);
+    if (idx >= 0) {
+      geometry_msgs::TransformStamped tf_transform = snapshot->joint_transforms[idx];
+      snapshot->joint_segments[idx].transform(jnt->second, tf_transform.transform);
       tf_transform.header.stamp = time;
-      tf_transform.header.frame_id = stripSlash(seg->second.root);
-      tf_transform.child_frame_id = stripSlash(seg->second.tip);
-      tf_transforms.push_back(tf_transform);
+      tf_message.transforms.push_back(tf_transform);
     }
     else {
       ROS_WARN_THROTTLE(10, "Joint state with name: \"%s\" was received but not found in URDF", jnt->first.c_str());
     }
   }
-  tf_broadcaster_.sendTransform(tf_transforms);
+  sendTransforms(tf_message, false);
+}
+
+// publish moving transforms from the dense joint table
+void RobotStatePublisher::publishTransforms(const KinematicSnapshot& snapshot,
+                                            const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                            const Time& time)
+{
+  publishBatch(snapshot, joint_positions, joint_valid, time, NULL);
+}
+
+// publish moving transforms from the dense joint table, stamped per joint
+void RobotStatePublisher::publishTransforms(const KinematicSnapshot& snapshot,
+                                            const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                            const std::vector<Time>& joint_stamps)
+{
+  publishBatch(snapshot, joint_positions, joint_valid, Time(), &joint_stamps);
+}
+
+void RobotStatePublisher::publishBatch(const KinematicSnapshot& snapshot,
+                                       const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                       const Time& time, const std::vector<Time>* joint_stamps)
+{
+  ROS_DEBUG("Publishing transforms for moving joints");
+  RSP_STATS(PipelineStats::TimePoint stage_start = PipelineStats::now());
+  boost::mutex::scoped_lock lock(tf_batch_mtx_);
+  TransformBatch& batch = publish_shared_messages_ ? nextSharedBatch() : tf_batch_;
+  fillBatch(batch, snapshot, joint_positions, joint_valid, time, joint_stamps);
+  RSP_STATS(stage_start = stats_.record(PipelineStats::TRANSFORMS, stage_start));
+  if (publish_shared_messages_) {
+    sendSharedTransforms(batch.message);
+  }
+  else {
+    sendTransforms(*batch.message, false);
+  }
+  RSP_STATS(stats_.record(PipelineStats::SEND, stage_start));
+}
+
+void RobotStatePublisher::fillBatch(TransformBatch& batch, const KinematicSnapshot& snapshot,
+                                    const std::vector<double>& joint_positions, const std::vector<char>& joint_valid,
+                                    const Time& time, const std::vector<Time>* joint_stamps)
+{
+  std::vector<geometry_msgs::TransformStamped>& tf_transforms = batch.message->transforms;
+  if (batch.version != snapshot.version) {
+    // label every joint of the new snapshot once
+    batch.parked = snapshot.joint_transforms;
+    tf_transforms.clear();
+    tf_transforms.reserve(batch.parked.size());
+    batch.joints.clear();
+    batch.joints.reserve(batch.parked.size());
+    batch.version = snapshot.version;
+  }
+  else {
+    // park the transforms of the last batch; moving them only moves their frame id strings
+    for (size_t n = 0; n < tf_transforms.size(); ++n) {
+      batch.parked[batch.joints[n]] = std::move(tf_transforms[n]);
+    }
+    tf_transforms.clear();
+    batch.joints.clear();
+  }
+
+  // loop over all joints in the table
+  const std::vector<SegmentPair>& joint_segments = snapshot.joint_segments;
+  for (size_t i = 0; i < joint_segments.size(); ++i) {
+    if (!joint_valid[i])  continue;
+    tf_transforms.push_back(std::move(batch.parked[i]));
+    batch.joints.push_back(static_cast<int>(i));
+    geometry_msgs::TransformStamped& tf_transform = tf_transforms.back();
+    joint_segments[i].transform(joint_positions[i], tf_transform.transform);
+    tf_transform.header.stamp = joint_stamps ? (*joint_stamps)[i] : time;
+  }
 }
 
 // publish fixed transforms
 void RobotStatePublisher::publishFixedTransforms(bool use_tf_static)
 {
-  boost::unique_lock<boost::shared_mutex> lock(m_swapMutex, boost::try_to_lock);
-  if (!lock.owns_lock())
-  {
-    ROS_DEBUG("Publishing transforms for fixed joints -- could not get lock");
-    return;
-  }
   ROS_DEBUG("Publishing transforms for fixed joints");
-  std::vector<geometry_msgs::TransformStamped> tf_transforms;
-  geometry_msgs::TransformStamped tf_transform;
+  boost::mutex::scoped_lock lock(fixed_tf_mtx_);
+  KinematicSnapshotConstPtr snapshot = getSnapshot();
+  if (fixed_tf_version_ != snapshot->version) {
+    fixed_tf_message_.transforms = snapshot->fixed_transforms;
+    fixed_tf_version_ = snapshot->version;
+  }
+
+  ros::Time stamp = ros::Time::now();
+  if (!use_tf_static) {
+    stamp += ros::Duration(0.5);
+  }
 
-  // loop over all fixed segments
-  for (map<string, SegmentPair>::const_iterator seg=segments_fixed_.begin(); seg != segments_fixed_.end(); seg++) {
-    geometry_msgs::TransformStamped tf_transform = tf2::kdlToTransform(seg->second.segment.pose(0));
-    tf_transform.header.stamp = ros::Time::now();
-    if (!use_tf_static) {
-      tf_transform.header.stamp += ros::Duration(0.5);
+  // the fixed transforms are prebuilt; only restamp them
+  std::vector<geometry_msgs::TransformStamped>& tf_transforms = fixed_tf_message_.transforms;
+  for (size_t i = 0; i < tf_transforms.size(); ++i) {
+    tf_transforms[i].header.stamp = stamp;
+  }
+  sendTransforms(fixed_tf_message_, use_tf_static);
+}
+
+// publish fixed transforms under another tf prefix
+void RobotStatePublisher::publishFixedTransforms(const std::string& tf_prefix)
+{
+  ROS_DEBUG("Publishing transforms for fixed joints under tf prefix %s", tf_prefix.c_str());
+  boost::mutex::scoped_lock lock(fixed_tf_mtx_);
+  KinematicSnapshotConstPtr snapshot = getSnapshot();
+  const std::string prefix = stripPrefix(tf_prefix);
+  if (prefixed_fixed_tf_version_ != snapshot->version || prefixed_fixed_tf_prefix_ != prefix) {
+    // relabel the prebuilt fixed transforms, so that both paths share one conversion
+    std::map<std::string, std::string> links;  // frame id -> link
+    for (std::map<std::string, std::string>::const_iterator id = snapshot->frame_ids.begin();
+         id != snapshot->frame_ids.end(); ++id) {
+      links[id->second] = id->first;
+    }
+    std::vector<geometry_msgs::TransformStamped>& tf_transforms = prefixed_fixed_tf_message_.transforms;
+    tf_transforms = snapshot->fixed_transforms;
+    for (size_t i = 0; i < tf_transforms.size(); ++i) {
+      tf_transforms[i].header.frame_id = prefixFrameId(prefix, links[tf_transforms[i].header.frame_id]);
+      tf_transforms[i].child_frame_id = prefixFrameId(prefix, links[tf_transforms[i].child_frame_id]);
     }
-    tf_transform.header.frame_id = stripSlash(seg->second.root);
-    tf_transform.child_frame_id = stripSlash(seg->second.tip);
-    tf_transforms.push_back(tf_transform);
+    prefixed_fixed_tf_version_ = snapshot->version;
+    prefixed_fixed_tf_prefix_ = prefix;
+  }
+
+  ros::Time stamp = ros::Time::now() + ros::Duration(0.5);
+  std::vector<geometry_msgs::TransformStamped>& tf_transforms = prefixed_fixed_tf_message_.transforms;
+  for (size_t i = 0; i < tf_transforms.size(); ++i) {
+    tf_transforms[i].header.stamp = stamp;
+  }
+  sendTransforms(prefixed_fixed_tf_message_, false);
+}
+
+void RobotStatePublisher::sendTransforms(const tf2_msgs::TFMessage& message, bool use_tf_static)
+{
+  if (!static_tf_broadcaster_) {
+    return;  // not advertised
   }
   if (use_tf_static) {
-    static_tf_broadcaster_.sendTransform(tf_transforms);
+    static_tf_broadcaster_->sendTransform(message.transforms);
+  }
+  else if (publish_shared_messages_) {
+    tf_pub_.publish(nextSharedMessage(message));
+  }
+  else {
+    tf_pub_.publish(message);
+  }
+}
+
+void RobotStatePublisher::sendSharedTransforms(const tf2_msgs::TFMessageConstPtr& message)
+{
+  if (!static_tf_broadcaster_) {
+    return;  // not advertised
+  }
+  tf_pub_.publish(message);
+}
+
+// a pooled batch that no subscriber holds any more; called with tf_batch_mtx_ held
+RobotStatePublisher::TransformBatch& RobotStatePublisher::nextSharedBatch()
+{
+  static const size_t pool_size = 4;
+  for (size_t i = 0; i < shared_tf_batches_.size(); ++i) {
+    if (shared_tf_batches_[i].message.unique()) {
+      return shared_tf_batches_[i];
+    }
+  }
+
+  // every pooled batch is still in use; replace the oldest one
+  if (shared_tf_batches_.size() < pool_size) {
+    shared_tf_batches_.push_back(TransformBatch());
+    return shared_tf_batches_.back();
+  }
+  TransformBatch& batch = shared_tf_batches_[next_shared_tf_batch_++ % pool_size];
+  batch = TransformBatch();
+  return batch;
+}
+
+// copy a message that was not built in the pool, e.g. the fixed transforms,
+// into a pooled message that no subscriber holds any more
+tf2_msgs::TFMessageConstPtr RobotStatePublisher::nextSharedMessage(const tf2_msgs::TFMessage& message)
+{
+  static const size_t pool_size = 4;
+  boost::mutex::scoped_lock lock(shared_tf_mtx_);
+  for (size_t i = 0; i < shared_tf_messages_.size(); ++i) {
+    if (shared_tf_messages_[i].unique()) {
+      *shared_tf_messages_[i] = message;
+      return shared_tf_messages_[i];
+    }
+  }
+
+  // every pooled message is still in use; replace the oldest one
+  tf2_msgs::TFMessage::Ptr shared(new tf2_msgs::TFMessage(message));
+  if (shared_tf_messages_.size() < pool_size) {
+    shared_tf_messages_.push_back(shared);
   }
   else {
-    tf_broadcaster_.sendTransform(tf_transforms);
+    shared_tf_messages_[next_shared_tf_message_++ % pool_size] = shared;
   }
+  return shared;
 }
 
 }
@@ -0,0 +1,140 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// robot_state_publisher_host.cpp
+// Serves many robots from one process.  Each robot lives in its own namespace
+// and publishes its frames under its own tf_prefix; robots loaded from the
+// same description share one parsed model until they change it.
+//
+// Parameters:
+//   ~robots   List of robot namespaces, or {namespace, tf_prefix} structs.
+//             The tf_prefix defaults to the namespace.
+//   ~threads  Number of threads serving the robots; each robot is served by
+//             one of them.  Defaults to the number of cores.
+// Every other private parameter of robot_state_publisher applies to all robots.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include "robot_state_publisher/joint_state_listener.h"
+#include "robot_state_publisher/shared_model.h"
+
+namespace
+{
+struct HostedRobot
+{
+  std::string ns;
+  std::string tf_prefix;
+};
+
+bool readRobots(const ros::NodeHandle& n_private, std::vector<HostedRobot>& robots)
+{
+  XmlRpc::XmlRpcValue list;
+  if (!n_private.getParam("robots", list) || list.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+    ROS_ERROR("robot_state_publisher_host: ~robots must list the robot namespaces");
+    return false;
+  }
+  for (int i = 0; i < list.size(); ++i) {
+    HostedRobot robot;
+    if (list[i].getType() == XmlRpc::XmlRpcValue::TypeString) {
+      robot.ns = static_cast<std::string&>(list[i]);
+      robot.tf_prefix = robot.ns;
+    }
+    else if (list[i].getType() == XmlRpc::XmlRpcValue::TypeStruct && list[i].hasMember("namespace")) {
+      robot.ns = static_cast<std::string&>(list[i]["namespace"]);
+      robot.tf_prefix = list[i].hasMember("tf_prefix") ? static_cast<std::string&>(list[i]["tf_prefix"]) : robot.ns;
+    }
+    else {
+      ROS_ERROR("robot_state_publisher_host: ignoring robot %d; expected a namespace or a {namespace, tf_prefix} struct", i);
+      continue;
+    }
+    robots.push_back(robot);
+  }
+  return !robots.empty();
+}
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "robot_state_publisher_host");
+  ros::NodeHandle n_private("~");
+
+  std::vector<HostedRobot> robots;
+  if (!readRobots(n_private, robots))
+    return -1;
+
+  int threads;
+  n_private.param("threads", threads, static_cast<int>(boost::thread::hardware_concurrency()));
+  threads = std::max(1, std::min(threads, static_cast<int>(robots.size())));
+
+  // A pool of single threaded queues: a robot's callbacks never run
+  // concurrently, and robots on different queues never wait for each other.
+  std::vector<boost::shared_ptr<ros::CallbackQueue> > queues;
+  for (int i = 0; i < threads; ++i) {
+    queues.push_back(boost::shared_ptr<ros::CallbackQueue>(new ros::CallbackQueue()));
+  }
+
+  std::vector<boost::shared_ptr<robot_state_publisher::JointStateListener> > listeners;
+  for (size_t i = 0; i < robots.size(); ++i) {
+    robot_state_publisher::RobotStatePublisherPtr state_publisher(new robot_state_publisher::RobotStatePublisher());
+    state_publisher->setNamespace(robots[i].ns);
+    state_publisher->setTfPrefix(robots[i].tf_prefix);
+
+    boost::shared_ptr<robot_state_publisher::JointStateListener> listener(
+      new robot_state_publisher::JointStateListener(state_publisher));
+    listener->setDedicatedCallbackThreads(false);
+    ros::NodeHandle n(robots[i].ns), n_robot_private("~");
+    n.setCallbackQueue(queues[i % queues.size()].get());
+    n_robot_private.setCallbackQueue(queues[i % queues.size()].get());
+    if (!listener->init(n, n_robot_private)) {
+      ROS_ERROR("robot_state_publisher_host: could not start the robot in %s", robots[i].ns.c_str());
+      continue;
+    }
+    listeners.push_back(listener);
+  }
+  ROS_INFO("robot_state_publisher_host: serving %zu robots with %zu distinct models on %d threads",
+           listeners.size(), robot_urdf::SharedModel::count(), threads);
+
+  std::vector<boost::shared_ptr<ros::AsyncSpinner> > spinners;
+  for (size_t i = 0; i < queues.size(); ++i) {
+    spinners.push_back(boost::shared_ptr<ros::AsyncSpinner>(new ros::AsyncSpinner(1, queues[i].get())));
+    spinners.back()->start();
+  }
+  ros::waitForShutdown();
+
+  // stop the threads before the robots they serve go away
+  spinners.clear();
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// robot_state_publisher_nodelet.cpp
+// JointStateListener in a nodelet manager, served by the manager's thread
+// pool.  Joint states from co-located nodelets arrive by pointer, and moving
+// transforms go out as shared messages, so intra-process subscribers skip
+// serialization in both directions.
+
+#include <boost/shared_ptr.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "robot_state_publisher/joint_state_listener.h"
+#include "robot_state_publisher/robot_state_publisher.h"
+
+namespace robot_state_publisher {
+
+class RobotStatePublisherNodelet : public nodelet::Nodelet
+{
+private:
+  virtual void onInit()
+  {
+    RobotStatePublisherPtr state_publisher(new RobotStatePublisher());
+    state_publisher->setPublishSharedMessages(true);
+    listener_.reset(new JointStateListener(state_publisher));
+    // served by the manager's threads, rather than by spinner threads of its
+    // own; joint states run concurrently, while URDF updates stay serialized
+    // on the nodelet's single threaded queue
+    listener_->setDedicatedCallbackThreads(false);
+    if (!listener_->init(getMTNodeHandle(), getPrivateNodeHandle()))
+    {
+      NODELET_ERROR("robot_state_publisher: failed to initialize");
+      listener_.reset();
+    }
+  }
+
+  boost::shared_ptr<JointStateListener> listener_;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(robot_state_publisher::RobotStatePublisherNodelet, nodelet::Nodelet)
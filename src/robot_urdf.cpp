@@ -32,7 +32,9 @@
 // Maintainer: Ian McMahon <imcmahon@rethinkrobotics.com>
 
 #include "robot_state_publisher/robot_urdf.h"
+#include "robot_state_publisher/pipeline_stats.h"
 #include <urdf_parser/urdf_parser.h>
+#include <algorithm>
 
 namespace robot_urdf {
 
@@ -54,19 +56,6 @@ static std::size_t xmlContentEnd(const std::string & doc, const std::string & ta
   return doc.rfind(end_tag);
 }
 
-static void xmlInsertContent(const std::string & content, const std::string & tag, std::string * doc)
-{
-  std::size_t pos = xmlContentEnd(*doc, tag);
-  if (pos != std::string::npos)
-  {
-    doc->insert(pos, content);
-  }
-  else
-  {
-    ROS_WARN("Could not insert XML content; end tag '%s' not found.", tag.c_str());
-  }
-}
-
 std::string xmlGetContent(const std::string & doc, const std::string & tag)
 {
   if (doc.empty())  return std::string();
@@ -86,16 +75,44 @@ std::string xmlGetContent(const std::string & doc, const std::string & tag)
 
 
 RobotURDF::RobotURDF()
-    : m_urdfPtrFg(new urdf::Model())
+    : m_urdfBaseEnd(std::string::npos)
+    , m_urdfPtrFg(new urdf::Model())
     , m_urdfPtrBg(new urdf::Model())
+    , m_bgStale(false)
     , m_valid(false)
     , m_updateCount(0)
+    , m_updateLockBusy(0)
+    , m_swapLockBusy(0)
+    , m_callbackQueue(NULL)
+    , m_writerPending(0)
+    , m_writerStop(false)
+{
+  m_change.incremental = false;
+}
+
+RobotURDF::~RobotURDF()
 {
+  {
+    boost::mutex::scoped_lock lock(m_writerMutex);
+    m_writerStop = true;
+  }
+  m_writerCond.notify_one();
+  if (m_writerThread.joinable())
+    m_writerThread.join();
+}
+
+void RobotURDF::setNamespace(const std::string & ns)
+{
+  m_namespace = ns;
+  while (!m_namespace.empty() && m_namespace[m_namespace.size() - 1] == '/')
+    m_namespace.erase(m_namespace.size() - 1);
+  if (!m_namespace.empty() && m_namespace[0] != '/')
+    m_namespace.insert(0, "/");
 }
 
 bool RobotURDF::init()
 {
-  return init(std::string("/robot_base_description"));
+  return init(m_namespace + "/robot_base_description");
 }
 
 bool RobotURDF::init(const std::string & urdfParamName)
@@ -106,27 +123,15 @@ bool RobotURDF::init(const std::string & urdfParamName)
 
   if (handle.getParam(urdfParamName, urdfString))
   {
-    m_urdfBase = urdfString;
-    m_valid =
-        m_urdfPtrFg->initString(urdfString) &&
-        m_urdfPtrBg->initString(urdfString);
-    if (m_valid)
+    if (initFromString(urdfString))
     {
-      regenerateUrdf();
-      swap();
-      regenerateUrdf();
-      swap();
-
-      ROS_INFO("RobotURDF:  Subscribing to /robot/urdf");
-      ros::NodeHandle handle("/robot");
+      ROS_INFO("RobotURDF:  Subscribing to %s/robot/urdf", m_namespace.c_str());
+      ros::NodeHandle handle(m_namespace + "/robot");
+      if (m_callbackQueue)  handle.setCallbackQueue(m_callbackQueue);
       m_URDFConfigurationSubscriber =
           handle.subscribe("urdf", 10, &RobotURDF::onURDFConfigurationMsg, this,
                            ros::TransportHints().tcpNoDelay());
     }
-    else
-    {
-      ROS_ERROR("RobotURDF:  Failed to parse urdf.");
-    }
   }
   else
   {
@@ -136,11 +141,151 @@ bool RobotURDF::init(const std::string & urdfParamName)
   return m_valid;
 }
 
+// The document is parsed once per process: the foreground and background
+// both point at the model shared by every robot loaded from the same
+// document, until the first URDFConfiguration detaches the background.
+bool RobotURDF::initFromString(const std::string & urdfString)
+{
+  m_sharedModel = SharedModel::acquire(urdfString);
+  m_urdfBase = m_sharedModel->doc;
+  m_urdfBaseEnd = xmlContentEnd(*m_urdfBase, "robot");
+  assembleUrdfDoc();
+  if (m_urdfDoc == m_urdfBase)
+  {
+    m_valid = m_sharedModel->modelValid;
+    if (m_valid)
+    {
+      m_urdfPtrFg = UrdfPtr(m_sharedModel, &m_sharedModel->model);
+      m_urdfPtrBg = m_urdfPtrFg;
+      m_bgStale = false;
+    }
+  }
+  else
+  {
+    // Fragments were loaded before the base; the assembled model is this robot's own.
+    m_sharedModel.reset();
+    m_urdfPtrFg.reset(new urdf::Model());
+    m_urdfPtrBg.reset(new urdf::Model());
+    m_valid = m_urdfPtrFg->initString(*m_urdfDoc);
+    if (m_valid)
+    {
+      cloneModel(*m_urdfPtrFg, *m_urdfPtrBg);
+      m_bgStale = false;
+    }
+  }
+  if (!m_valid)
+  {
+    ROS_ERROR("RobotURDF:  Failed to parse urdf.");
+  }
+  return m_valid;
+}
+
+// Give the background a model of its own before it is modified, as long as
+// it is still the shared one, and let go of the shared model once neither
+// the foreground nor the background uses it.
+void RobotURDF::detachBackground()
+{
+  if (m_sharedModel && m_urdfPtrBg.get() == &m_sharedModel->model)
+  {
+    UrdfPtr copy(new urdf::Model());
+    cloneModel(*m_urdfPtrBg, *copy);
+    m_urdfPtrBg = copy;
+  }
+  if (!sharesModel())
+  {
+    m_sharedModel.reset();
+  }
+}
+
+bool RobotURDF::sharesModel() const
+{
+  return m_sharedModel &&
+      (m_urdfPtrFg.get() == &m_sharedModel->model || m_urdfPtrBg.get() == &m_sharedModel->model);
+}
+
+// Deep copy of a model, so that the copy can be modified on its own.
+// Geometry, inertia and materials are shared, as they are never modified.
+void RobotURDF::cloneModel(const urdf::Model & source, urdf::Model & target)
+{
+  target.clear();
+  target.name_ = source.name_;
+  target.materials_ = source.materials_;
+  for (std::map<std::string, urdf::LinkSharedPtr>::const_iterator link = source.links_.begin();
+       link != source.links_.end(); link++)
+  {
+    target.links_[link->first].reset(new urdf::Link(*link->second));
+  }
+  for (std::map<std::string, urdf::JointSharedPtr>::const_iterator joint = source.joints_.begin();
+       joint != source.joints_.end(); joint++)
+  {
+    target.joints_[joint->first].reset(new urdf::Joint(*joint->second));
+  }
+
+  // Point the copied links at each other and at the copied joints:
+  for (std::map<std::string, urdf::LinkSharedPtr>::iterator link = target.links_.begin();
+       link != target.links_.end(); link++)
+  {
+    urdf::Link & copy = *link->second;
+    if (copy.parent_joint)
+    {
+      copy.parent_joint = target.joints_[copy.parent_joint->name];
+    }
+    urdf::LinkSharedPtr parent = copy.getParent();
+    if (parent)
+    {
+      copy.setParent(target.links_[parent->name]);
+    }
+    for (size_t i = 0; i < copy.child_joints.size(); ++i)
+    {
+      copy.child_joints[i] = target.joints_[copy.child_joints[i]->name];
+    }
+    for (size_t i = 0; i < copy.child_links.size(); ++i)
+    {
+      copy.child_links[i] = target.links_[copy.child_links[i]->name];
+    }
+  }
+  if (source.root_link_)
+  {
+    target.root_link_ = target.links_[source.root_link_->name];
+  }
+}
+
 void RobotURDF::setRobotDescription()
 {
-  // Only one node should do this -- it takes 12 ms.
-  ROS_INFO("Saving the URDF to the parameter server");
-  ros::param::set("/robot_description", m_urdfDoc);
+  ensureModel();
+  boost::mutex::scoped_lock lock(m_writerMutex);
+  m_writerDoc = m_urdfDoc;  // Latest wins; the document is shared, not copied
+  ++m_writerPending;
+  if (!m_writerThread.joinable())
+    m_writerThread = boost::thread(&RobotURDF::descriptionWriterLoop, this);
+  m_writerCond.notify_one();
+}
+
+void RobotURDF::descriptionWriterLoop()
+{
+  ConstStringPtr doc;
+  boost::mutex::scoped_lock lock(m_writerMutex);
+  while (true)
+  {
+    while (!m_writerPending && !m_writerStop)
+      m_writerCond.wait(lock);
+    if (m_writerStop)
+      break;
+
+    uint32_t requests = m_writerPending;
+    m_writerPending = 0;
+    doc.swap(m_writerDoc);
+    lock.unlock();
+
+    // Only one node should do this -- it takes 12 ms.
+    ros::WallTime start = ros::WallTime::now();
+    ros::param::set(m_namespace + "/robot_description", *doc);
+    ROS_INFO("Saved the URDF to the parameter server in %.1f ms (%u requests)",
+             (ros::WallTime::now() - start).toSec() * 1000.0, requests);
+
+    doc.reset();
+    lock.lock();
+  }
 }
 
 void RobotURDF::loadUrdfFragmentParam(const std::string & paramName,
@@ -160,41 +305,221 @@ void RobotURDF::loadUrdfFragmentParam(const std::string & paramName,
     // Store just the content of the XML fragment -- expected to be found in a "robot" element:
     fragment.xml = xmlGetContent(urdfString, "robot");
     fragment.timestamp = ros::Time::now().toSec();
+    fragment.grafted = false;
   }
 }
 
 
+void RobotURDF::assembleUrdfDoc()
+{
+  // The base document is only copied once there is a fragment to insert:
+  std::size_t size = m_urdfBase->size();
+  for (URDFFragmentMap::const_iterator pair = m_urdfMap.begin(); pair != m_urdfMap.end(); pair++)
+  {
+    size += pair->second.xml.size();
+  }
+  if (size == m_urdfBase->size())
+  {
+    m_urdfDoc = m_urdfBase;
+    return;
+  }
+  if (m_urdfBaseEnd == std::string::npos)
+  {
+    ROS_WARN("Could not insert XML content; end tag '</robot' not found.");
+    m_urdfDoc = m_urdfBase;
+    return;
+  }
+
+  // Copy the base up to its closing tag, the content of each fragment, then
+  // the closing tag, into a buffer sized for the whole document:
+  boost::shared_ptr<std::string> doc(new std::string());
+  doc->reserve(size);
+  doc->append(*m_urdfBase, 0, m_urdfBaseEnd);
+  for (URDFFragmentMap::const_iterator pair = m_urdfMap.begin(); pair != m_urdfMap.end(); pair++)
+  {
+    doc->append(pair->second.xml);
+  }
+  doc->append(*m_urdfBase, m_urdfBaseEnd, std::string::npos);
+  m_urdfDoc = doc;
+}
+
 bool RobotURDF::regenerateUrdf()
 {
-  static std::string root("robot");  // root element tag
+  assembleUrdfDoc();
+  try
+  {
+    m_urdfPtrBg->initString(*m_urdfDoc);
+    // TODO: handle invalid doc
+  }
+  catch(std::exception & e)
+  {
+    ROS_ERROR("Could not regenerate URDF: %s", e.what());
+    return false;
+  }
+
+  return true;
+}
+
 
-  // Copy the base document:
-  m_urdfDoc = m_urdfBase;
-  //for (auto & pair : m_urdfMap)
-  for (URDFFragmentMap::iterator pair = m_urdfMap.begin(); pair != m_urdfMap.end(); pair++)
+// ----------------------------------------------------------------
+// Incremental updates:  instead of re-parsing the whole document, only the
+// changed fragment is parsed and its links and joints are grafted onto (or
+// pruned from) the background model.
+
+// A change can be grafted when the background model is current, the links
+// of the previous fragment are known, and no other fragment hangs off them.
+bool RobotURDF::canGraft(const URDFChange & change) const
+{
+  if (m_bgStale)  return false;
+  const URDFFragment & previous = change.previous;
+  if (previous.xml.empty())  return true;
+  if (!previous.grafted)  return false;
+  for (URDFFragmentMap::const_iterator pair = m_urdfMap.begin(); pair != m_urdfMap.end(); pair++)
   {
-    // insert the children of each fragment into the document:
-    std::string & frag = pair->second.xml;
-    if (!frag.empty())
+    if (pair->first == change.key || pair->second.xml.empty())  continue;
+    if (std::find(previous.links.begin(), previous.links.end(), pair->second.parentLink) != previous.links.end())
     {
-      // Insert the fragment content into the base XML document:
-      xmlInsertContent(frag, root, &m_urdfDoc);
+      return false;
     }
   }
+  return true;
+}
+
+// Parse a fragment on its own, rooted at a stand-in for its parent link,
+// and record the links and joints it adds.
+bool RobotURDF::parseFragment(URDFFragment & fragment, UrdfPtr & model) const
+{
+  model.reset();
+  fragment.links.clear();
+  fragment.joints.clear();
+  if (fragment.xml.empty())  return true;
+
+  UrdfPtr fragmentModel(new urdf::Model());
+  std::string doc = "<robot name=\"fragment\"><link name=\"" + fragment.parentLink + "\"/>" +
+      fragment.xml + "</robot>";
   try
   {
-    m_urdfPtrBg->initString(m_urdfDoc);
-    // TODO: handle invalid doc
+    if (!fragmentModel->initString(doc))  return false;
   }
   catch(std::exception & e)
   {
-    ROS_ERROR("Could not regenerate URDF: %s", e.what());
+    ROS_DEBUG("RobotURDF: Could not parse fragment on its own: %s", e.what());
     return false;
   }
+  for (std::map<std::string, urdf::LinkSharedPtr>::const_iterator link = fragmentModel->links_.begin();
+       link != fragmentModel->links_.end(); link++)
+  {
+    if (link->first != fragment.parentLink)  fragment.links.push_back(link->first);
+  }
+  for (std::map<std::string, urdf::JointSharedPtr>::const_iterator joint = fragmentModel->joints_.begin();
+       joint != fragmentModel->joints_.end(); joint++)
+  {
+    fragment.joints.push_back(joint->first);
+  }
+  model = fragmentModel;
+  return true;
+}
 
+// Move the links and joints of a parsed fragment into the target model.
+// The fragment model is consumed: its links are re-parented into the target.
+bool RobotURDF::graftFragment(urdf::Model & target, const urdf::Model & fragment, const std::string & parentLink)
+{
+  std::map<std::string, urdf::LinkSharedPtr>::iterator parent = target.links_.find(parentLink);
+  std::map<std::string, urdf::LinkSharedPtr>::const_iterator root = fragment.links_.find(parentLink);
+  if ((parent == target.links_.end()) || (root == fragment.links_.end()))
+  {
+    return false;
+  }
+  for (std::map<std::string, urdf::LinkSharedPtr>::const_iterator link = fragment.links_.begin();
+       link != fragment.links_.end(); link++)
+  {
+    if ((link != root) && target.links_.count(link->first))  return false;
+  }
+  for (std::map<std::string, urdf::JointSharedPtr>::const_iterator joint = fragment.joints_.begin();
+       joint != fragment.joints_.end(); joint++)
+  {
+    if (target.joints_.count(joint->first))  return false;
+  }
+
+  for (std::map<std::string, urdf::LinkSharedPtr>::const_iterator link = fragment.links_.begin();
+       link != fragment.links_.end(); link++)
+  {
+    if (link != root)  target.links_.insert(*link);
+  }
+  target.joints_.insert(fragment.joints_.begin(), fragment.joints_.end());
+  target.materials_.insert(fragment.materials_.begin(), fragment.materials_.end());
+
+  const urdf::LinkSharedPtr & parentPtr = parent->second;
+  for (size_t i = 0; i < root->second->child_links.size(); ++i)
+  {
+    root->second->child_links[i]->setParent(parentPtr);
+    parentPtr->child_links.push_back(root->second->child_links[i]);
+  }
+  parentPtr->child_joints.insert(parentPtr->child_joints.end(),
+                                 root->second->child_joints.begin(), root->second->child_joints.end());
   return true;
 }
 
+// Remove the links and joints a fragment added from the target model.
+void RobotURDF::pruneFragment(urdf::Model & target, const URDFFragment & fragment)
+{
+  std::map<std::string, urdf::LinkSharedPtr>::iterator parent = target.links_.find(fragment.parentLink);
+  for (size_t i = 0; i < fragment.links.size(); ++i)
+  {
+    std::map<std::string, urdf::LinkSharedPtr>::iterator link = target.links_.find(fragment.links[i]);
+    if (link == target.links_.end())  continue;
+    if (parent != target.links_.end())
+    {
+      std::vector<urdf::LinkSharedPtr> & children = parent->second->child_links;
+      children.erase(std::remove(children.begin(), children.end(), link->second), children.end());
+    }
+    target.links_.erase(link);
+  }
+  for (size_t i = 0; i < fragment.joints.size(); ++i)
+  {
+    std::map<std::string, urdf::JointSharedPtr>::iterator joint = target.joints_.find(fragment.joints[i]);
+    if (joint == target.joints_.end())  continue;
+    if (parent != target.links_.end())
+    {
+      std::vector<urdf::JointSharedPtr> & joints = parent->second->child_joints;
+      joints.erase(std::remove(joints.begin(), joints.end(), joint->second), joints.end());
+    }
+    target.joints_.erase(joint);
+  }
+}
+
+// Apply the current change to a model which matches the previous URDF.
+bool RobotURDF::applyChange(urdf::Model & target)
+{
+  if (m_change.previous.grafted)
+  {
+    pruneFragment(target, m_change.previous);
+  }
+  if (m_change.fragment)
+  {
+    return graftFragment(target, *m_change.fragment, m_urdfMap[m_change.key].parentLink);
+  }
+  return true;
+}
+
+// Bring the background model up to date with the current change, grafting
+// the fragment when possible and re-parsing the whole document otherwise.
+bool RobotURDF::updateUrdf()
+{
+  URDFFragment & fragment = m_urdfMap[m_change.key];
+  m_change.incremental = false;
+  fragment.grafted = parseFragment(fragment, m_change.fragment);
+
+  if (fragment.grafted && canGraft(m_change))
+  {
+    assembleUrdfDoc();
+    m_change.incremental = applyChange(*m_urdfPtrBg);
+    if (m_change.incremental)  return true;
+    ROS_DEBUG("RobotURDF: Could not graft %s; regenerating the URDF.", m_change.key.c_str());
+  }
+  return regenerateUrdf();
+}
+
 
 // URDFConfiguration subscriber callback.
 void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration &config)
@@ -222,6 +547,7 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
   URDFFragmentMap::iterator pair = m_urdfMap.find(key);
   if (!updateLock.owns_lock())
   {
+    RSP_STATS(++m_updateLockBusy);
     // Only report this when we actually need to update the URDF.
     if ((pair != m_urdfMap.end()) &&
         (configTimestamp > pair->second.timestamp))
@@ -232,20 +558,31 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
     }
     return;
   }
+  ensureModel();
   double startChange = ros::Time::now().toSec();  // Time URDF updates.
 
   URDFFragment & fragment = m_urdfMap[key];
   if (configTimestamp > fragment.timestamp)
   {
+    // Store just the content of the XML fragment -- expected to be found in a "robot" element:
+    //std::string xml = xmlGetContent(hu::URDF::jsonToUrdf(config.urdf), "robot");
+    std::string xml = xmlGetContent(config.urdf, "robot");
+    if (m_valid && (fragment.timestamp > 0.0) && (xml == fragment.xml) && (linkName == fragment.parentLink))
+    {
+      // The same fragment again, e.g. re-sent with a newer timestamp; nothing to rebuild.
+      ROS_DEBUG("RobotURDF:  URDFConfiguration %s is unchanged (%f > %f)",
+                key.c_str(), configTimestamp, fragment.timestamp);
+      fragment.timestamp = configTimestamp;
+      return;
+    }
+
     ROS_INFO("RobotURDF:  URDFConfiguration update #%d, %s (%f > %f)",
               m_updateCount, key.c_str(), configTimestamp, fragment.timestamp);
-    std::string oldXml = fragment.xml;            // In case we have to revert it.
-    double oldTimestamp = fragment.timestamp;     // In case we have to revert it.
+    m_change.key = key;
+    m_change.previous = fragment;                 // In case we have to revert it.
     fragment.parentLink = linkName;
     fragment.jointName = jointName;
-    // Store just the content of the XML fragment -- expected to be found in a "robot" element:
-    //fragment.xml = xmlGetContent(hu::URDF::jsonToUrdf(config.urdf), "robot");
-    fragment.xml = xmlGetContent(config.urdf, "robot");
+    fragment.xml.swap(xml);
     // Note that if the fragment is empty (i.e., deleted) we still want to keep
     //  it so we don't handle the message again.
 
@@ -256,10 +593,12 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
       ROS_ERROR("URDFConfiguration failed; invalid urdf fragment:\n%s\n",
                 config.urdf.c_str());
       m_valid = false;
+      m_bgStale = true;
       return;
     }
 
     // Update resources in the background in response to the URDF change:
+    detachBackground();
     m_valid = onURDFChange(linkName);
     if (m_valid)
     {
@@ -276,6 +615,7 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
       }
       else
       {
+        RSP_STATS(++m_swapLockBusy);
         ROS_INFO("RobotURDF: URDFConfiguration update %s (%f) failed to acquire swap lock.",
                  key.c_str(), configTimestamp);
         // It's OK -- unless something is seriously broken we'll get the lock the next time around (or the next).
@@ -283,6 +623,13 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
         m_valid = false;
       }
       ROS_INFO("URDFChange time: %f", ros::Time::now().toSec() - startChange);
+
+      // The new background still holds the previous URDF; replay the change on it.
+      if (m_valid)  detachBackground();
+      if (m_valid && !syncBackground())
+      {
+        ROS_WARN("RobotURDF: Could not bring background resources up to date; the next update regenerates them.");
+      }
     }
     else
     {
@@ -293,9 +640,10 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
 
     if (!m_valid)
     {
-      // When the update fails restore the cached old data.
-      fragment.timestamp = oldTimestamp;
-      fragment.xml = oldXml;
+      // When the update fails restore the cached old data.  The background
+      // resources may hold part of the change, so regenerate them next time.
+      fragment = m_change.previous;
+      m_bgStale = true;
     }
   }
 }
@@ -305,7 +653,7 @@ void RobotURDF::onURDFConfigurationMsg(const intera_core_msgs::URDFConfiguration
 bool RobotURDF::onURDFChange(const std::string &link_name)
 {
   // Overriding subclasses must call this.
-  m_valid = regenerateUrdf();
+  m_valid = updateUrdf();
   return m_valid;
 }
 
@@ -316,4 +664,23 @@ void RobotURDF::onURDFSwap(const std::string &link_name)
   swap();
 }
 
+// Invoked after a swap to replay the change on the new background resources,
+// which still hold the previous URDF.
+bool RobotURDF::syncBackground()
+{
+  // Overriding subclasses must call this.
+  if (m_change.incremental)
+  {
+    URDFFragment & fragment = m_urdfMap[m_change.key];
+    if (parseFragment(fragment, m_change.fragment) && applyChange(*m_urdfPtrBg))
+    {
+      m_bgStale = false;
+      return true;
+    }
+    m_change.incremental = false;
+  }
+  m_bgStale = !regenerateUrdf();
+  return !m_bgStale;
+}
+
 }  // namespace robot_urdf
@@ -0,0 +1,109 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// shared_model.cpp
+
+#include <map>
+
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <kdl_parser/kdl_parser.hpp>
+
+#include "robot_state_publisher/shared_model.h"
+
+namespace robot_urdf {
+
+namespace {
+
+// Documents by content hash.  Entries only hold weak references, so a model
+// is freed once no robot uses it; expired entries are swept on insertion.
+typedef std::multimap<size_t, boost::weak_ptr<SharedModel> > SharedModelMap;
+
+boost::mutex & registryMutex()
+{
+  static boost::mutex mutex;
+  return mutex;
+}
+
+SharedModelMap & registry()
+{
+  static SharedModelMap models;
+  return models;
+}
+
+}  // namespace
+
+SharedModel::Ptr SharedModel::acquire(const std::string & doc)
+{
+  size_t hash = boost::hash<std::string>()(doc);
+  boost::mutex::scoped_lock lock(registryMutex());
+  SharedModelMap & models = registry();
+
+  std::pair<SharedModelMap::iterator, SharedModelMap::iterator> range = models.equal_range(hash);
+  for (SharedModelMap::iterator entry = range.first; entry != range.second; ++entry)
+  {
+    Ptr shared = entry->second.lock();
+    if (shared && *shared->doc == doc)
+    {
+      return shared;
+    }
+  }
+
+  // Parse while holding the lock, so that robots starting together with the
+  // same document wait for one parse rather than each running their own.
+  Ptr shared(new SharedModel());
+  shared->doc.reset(new std::string(doc));
+  shared->modelValid = shared->model.initString(doc);
+  if (shared->modelValid)
+  {
+    shared->treeValid = kdl_parser::treeFromUrdfModel(shared->model, shared->tree);
+  }
+
+  for (SharedModelMap::iterator entry = models.begin(); entry != models.end(); )
+  {
+    if (entry->second.expired())  models.erase(entry++);
+    else  ++entry;
+  }
+  models.insert(std::make_pair(hash, boost::weak_ptr<SharedModel>(shared)));
+  return shared;
+}
+
+size_t SharedModel::count()
+{
+  boost::mutex::scoped_lock lock(registryMutex());
+  size_t live = 0;
+  for (SharedModelMap::const_iterator entry = registry().begin(); entry != registry().end(); ++entry)
+  {
+    if (!entry->second.expired())  ++live;
+  }
+  return live;
+}
+
+}  // namespace robot_urdf
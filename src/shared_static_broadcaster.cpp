@@ -0,0 +1,74 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// shared_static_broadcaster.cpp
+
+#include <boost/weak_ptr.hpp>
+
+#include "robot_state_publisher/shared_static_broadcaster.h"
+
+namespace robot_state_publisher {
+
+namespace {
+
+boost::mutex & registryMutex()
+{
+  static boost::mutex mutex;
+  return mutex;
+}
+
+// Only a weak reference, so /tf_static is unadvertised with the last robot.
+boost::weak_ptr<SharedStaticBroadcaster> & registry()
+{
+  static boost::weak_ptr<SharedStaticBroadcaster> broadcaster;
+  return broadcaster;
+}
+
+}  // namespace
+
+SharedStaticBroadcaster::Ptr SharedStaticBroadcaster::acquire()
+{
+  boost::mutex::scoped_lock lock(registryMutex());
+  Ptr shared = registry().lock();
+  if (!shared)
+  {
+    shared.reset(new SharedStaticBroadcaster());
+    registry() = shared;
+  }
+  return shared;
+}
+
+void SharedStaticBroadcaster::sendTransform(const std::vector<geometry_msgs::TransformStamped> & transforms)
+{
+  // tf2_ros::StaticTransformBroadcaster merges into its message unguarded
+  boost::mutex::scoped_lock lock(mutex_);
+  broadcaster_.sendTransform(transforms);
+}
+
+}  // namespace robot_state_publisher
@@ -0,0 +1,353 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// treefksolverposfull_flat.cpp
+
+#include <ros/ros.h>
+
+#include "robot_state_publisher/treefksolverposfull_flat.hpp"
+
+using namespace std;
+
+namespace KDL {
+
+namespace {
+typedef TreeFkSolverPosFull_flat::BatchArray BatchArray;
+const int F = TreeFkSolverPosFull_flat::BATCH_FRAME_SIZE;
+
+// Pose of a segment whose joint is described by a kernel, evaluated one configuration at a time
+Frame kernelPose(const Vector& axis, const Vector& origin, const Frame& tip, bool rotation, double q)
+{
+  if (rotation) {
+    Rotation r = Rotation::Rot2(axis, q);
+    return Frame(r * tip.M, r * (tip.p - origin) + origin);
+  }
+  return Frame(tip.M, tip.p + axis * q);
+}
+
+// out[out_col] = parent[parent_col] * local, for every configuration
+void composeBatch(const BatchArray& parent, Eigen::Index parent_col, const BatchArray& local,
+                  BatchArray& out, Eigen::Index out_col)
+{
+  for (int r = 0; r < 3; ++r) {
+    const Eigen::Index p = parent_col + 3 * r;
+    for (int c = 0; c < 3; ++c) {
+      out.col(out_col + 3 * r + c) = parent.col(p) * local.col(c) + parent.col(p + 1) * local.col(3 + c) +
+                                     parent.col(p + 2) * local.col(6 + c);
+    }
+    out.col(out_col + 9 + r) = parent.col(p) * local.col(9) + parent.col(p + 1) * local.col(10) +
+                               parent.col(p + 2) * local.col(11) + parent.col(parent_col + 9 + r);
+  }
+}
+
+// out[out_col] = parent[parent_col] * fixed, for every configuration
+void composeConstant(const BatchArray& parent, Eigen::Index parent_col, const Frame& fixed,
+                     BatchArray& out, Eigen::Index out_col)
+{
+  for (int r = 0; r < 3; ++r) {
+    const Eigen::Index p = parent_col + 3 * r;
+    for (int c = 0; c < 3; ++c) {
+      out.col(out_col + 3 * r + c) = parent.col(p) * fixed.M(0, c) + parent.col(p + 1) * fixed.M(1, c) +
+                                     parent.col(p + 2) * fixed.M(2, c);
+    }
+    out.col(out_col + 9 + r) = parent.col(p) * fixed.p.x() + parent.col(p + 1) * fixed.p.y() +
+                               parent.col(p + 2) * fixed.p.z() + parent.col(parent_col + 9 + r);
+  }
+}
+}  // namespace
+
+TreeFkSolverPosFull_flat::TreeFkSolverPosFull_flat(const Tree& _tree)
+{
+  addSegment(_tree.getRootSegment(), -1);
+}
+
+TreeFkSolverPosFull_flat::~TreeFkSolverPosFull_flat()
+{
+}
+
+// append a segment and, depth first, its children
+void TreeFkSolverPosFull_flat::addSegment(const SegmentMap::const_iterator segment, int parent)
+{
+  const Segment& kdl_segment = GetTreeElementSegment(segment->second);
+  const Joint& joint = kdl_segment.getJoint();
+
+  Node node;
+  node.parent = parent;
+  node.joint = -1;
+  node.type = joint.getType();
+  if (node.type == Joint::None) {
+    node.fixed = kdl_segment.pose(0);
+  }
+  else {
+    map<string, int>::const_iterator existing = joint_index.find(joint.getName());
+    if (existing == joint_index.end()) {
+      existing = joint_index.insert(make_pair(joint.getName(), static_cast<int>(joint_names.size()))).first;
+      joint_names.push_back(joint.getName());
+    }
+    node.joint = existing->second;
+  }
+
+  int index = nodes.size();
+  nodes.push_back(node);
+  segments.push_back(kdl_segment);
+  segment_names.push_back(segment->first);
+  segment_parents.push_back(parent);
+  segment_index[segment->first] = index;
+  buildBatchKernel(index);
+
+  const vector<SegmentMap::const_iterator>& children = GetTreeElementChildren(segment->second);
+  for (size_t i = 0; i < children.size(); ++i) {
+    addSegment(children[i], index);
+  }
+}
+
+void TreeFkSolverPosFull_flat::buildBatchKernel(int index)
+{
+  const Segment& segment = segments[index];
+  const Joint& joint = segment.getJoint();
+
+  BatchKernel kernel;
+  kernel.tip = segment.pose(0);
+  kernel.axis = joint.JointAxis();
+  kernel.axis.Normalize();
+  kernel.origin = joint.JointOrigin();
+  switch (joint.getType()) {
+  case Joint::None:
+    kernel.kind = BatchKernel::FIXED;
+    break;
+  case Joint::RotAxis: case Joint::RotX: case Joint::RotY: case Joint::RotZ:
+    kernel.kind = BatchKernel::ROTATION;
+    break;
+  case Joint::TransAxis: case Joint::TransX: case Joint::TransY: case Joint::TransZ:
+    kernel.kind = BatchKernel::TRANSLATION;
+    break;
+  default:
+    kernel.kind = BatchKernel::GENERIC;
+  }
+
+  // The closed forms assume the unit scale and zero offset kdl_parser gives
+  // every joint; anything else is evaluated through Segment::pose().
+  if (kernel.kind == BatchKernel::ROTATION || kernel.kind == BatchKernel::TRANSLATION) {
+    const double samples[] = { 0.5, -2.0 };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+      Frame expected = segment.pose(samples[i]);
+      Frame actual = kernelPose(kernel.axis, kernel.origin, kernel.tip, kernel.kind == BatchKernel::ROTATION, samples[i]);
+      if (!Equal(expected, actual, 1e-9)) {
+        kernel.kind = BatchKernel::GENERIC;
+      }
+    }
+  }
+  kernels.push_back(kernel);
+}
+
+int TreeFkSolverPosFull_flat::getSegmentIndex(const string& name) const
+{
+  map<string, int>::const_iterator it = segment_index.find(name);
+  return it == segment_index.end() ? -1 : it->second;
+}
+
+int TreeFkSolverPosFull_flat::getJointIndex(const string& name) const
+{
+  map<string, int>::const_iterator it = joint_index.find(name);
+  return it == joint_index.end() ? -1 : it->second;
+}
+
+int TreeFkSolverPosFull_flat::JntToCart(const vector<double>& q_in, const vector<char>& q_valid,
+                                        vector<Frame>& p_out, vector<char>& p_valid, bool flatten_tree) const
+{
+  if (q_in.size() < joint_names.size() || q_valid.size() < joint_names.size()) {
+    return -1;
+  }
+
+  const size_t n = nodes.size();
+  p_out.resize(n);
+  p_valid.resize(n);
+  const Frame identity = Frame::Identity();
+
+  // Parents precede their children, so one pass computes every pose.  The
+  // products are formed exactly as the recursive solver forms them.
+  for (size_t i = 0; i < n; ++i) {
+    const Node& node = nodes[i];
+    bool valid = node.parent < 0 || p_valid[node.parent];
+    if (valid && node.joint >= 0) {
+      valid = q_valid[node.joint];
+    }
+    p_valid[i] = valid;
+    if (!valid) {
+      continue;
+    }
+
+    const Frame& previous = (node.parent < 0 || !flatten_tree) ? identity : p_out[node.parent];
+    if (node.joint < 0) {
+      p_out[i] = previous * node.fixed;
+    }
+    else {
+      p_out[i] = previous * segments[i].pose(q_in[node.joint]);
+    }
+  }
+  return 0;
+}
+
+int TreeFkSolverPosFull_flat::JntToCart(const map<string, double>& q_in, map<string, tf2::Stamped<Frame> >& p_out, bool flatten_tree)
+{
+  // clear output
+  p_out.clear();
+
+  q_scratch.assign(joint_names.size(), 0.0);
+  q_valid_scratch.assign(joint_names.size(), 0);
+  for (map<string, double>::const_iterator q = q_in.begin(); q != q_in.end(); ++q) {
+    int index = getJointIndex(q->first);
+    if (index >= 0) {
+      q_scratch[index] = q->second;
+      q_valid_scratch[index] = 1;
+    }
+  }
+
+  int result = JntToCart(q_scratch, q_valid_scratch, p_scratch, p_valid_scratch, flatten_tree);
+  if (result < 0) {
+    return result;
+  }
+
+  // the root itself is not reported
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    if (p_valid_scratch[i]) {
+      const string& frame_id = flatten_tree ? segment_names[0] : segment_names[nodes[i].parent];
+      p_out.insert(make_pair(segment_names[i], tf2::Stamped<Frame>(p_scratch[i], ros::Time(), frame_id)));
+    }
+  }
+  return 0;
+}
+
+int TreeFkSolverPosFull_flat::JntToCartBatch(const BatchArray& q_in, BatchArray& p_out, bool flatten_tree) const
+{
+  if (q_in.cols() != static_cast<Eigen::Index>(joint_names.size())) {
+    return -1;
+  }
+
+  const Eigen::Index configs = q_in.rows();
+  p_out.resize(configs, F * nodes.size());
+  BatchArray local(configs, F);
+  BatchArray rotation(configs, 9);
+  BatchArray trig(configs, 3);
+
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Node& node = nodes[i];
+    const BatchKernel& kernel = kernels[i];
+    const Frame& tip = kernel.tip;
+    const Eigen::Index out_col = F * i;
+    const bool compose = node.parent >= 0 && flatten_tree;
+
+    if (kernel.kind == BatchKernel::FIXED) {
+      if (compose) {
+        composeConstant(p_out, F * node.parent, tip, p_out, out_col);
+      }
+      else {
+        for (int k = 0; k < 9; ++k) {
+          p_out.col(out_col + k).setConstant(tip.M.data[k]);
+        }
+        for (int k = 0; k < 3; ++k) {
+          p_out.col(out_col + 9 + k).setConstant(tip.p(k));
+        }
+      }
+      continue;
+    }
+
+    const BatchArray::ConstColXpr q = q_in.col(node.joint);
+    switch (kernel.kind) {
+    case BatchKernel::ROTATION: {
+      // Rotation about the joint axis (Rodrigues), then the fixed tip offset
+      const double x = kernel.axis.x(), y = kernel.axis.y(), z = kernel.axis.z();
+      trig.col(0) = q.cos();
+      trig.col(1) = q.sin();
+      trig.col(2) = 1.0 - trig.col(0);
+      const BatchArray::ColXpr c = trig.col(0), s = trig.col(1), v = trig.col(2);
+      rotation.col(0) = c + x * x * v;
+      rotation.col(1) = x * y * v - z * s;
+      rotation.col(2) = x * z * v + y * s;
+      rotation.col(3) = x * y * v + z * s;
+      rotation.col(4) = c + y * y * v;
+      rotation.col(5) = y * z * v - x * s;
+      rotation.col(6) = x * z * v - y * s;
+      rotation.col(7) = y * z * v + x * s;
+      rotation.col(8) = c + z * z * v;
+
+      const Vector offset = tip.p - kernel.origin;
+      for (int r = 0; r < 3; ++r) {
+        for (int cc = 0; cc < 3; ++cc) {
+          local.col(3 * r + cc) = rotation.col(3 * r) * tip.M(0, cc) + rotation.col(3 * r + 1) * tip.M(1, cc) +
+                                  rotation.col(3 * r + 2) * tip.M(2, cc);
+        }
+        local.col(9 + r) = rotation.col(3 * r) * offset.x() + rotation.col(3 * r + 1) * offset.y() +
+                           rotation.col(3 * r + 2) * offset.z() + kernel.origin(r);
+      }
+      break;
+    }
+    case BatchKernel::TRANSLATION:
+      for (int k = 0; k < 9; ++k) {
+        local.col(k).setConstant(tip.M.data[k]);
+      }
+      for (int r = 0; r < 3; ++r) {
+        local.col(9 + r) = tip.p(r) + kernel.axis(r) * q;
+      }
+      break;
+    default:
+      for (Eigen::Index config = 0; config < configs; ++config) {
+        Frame pose = segments[i].pose(q(config));
+        for (int k = 0; k < 9; ++k) {
+          local(config, k) = pose.M.data[k];
+        }
+        for (int k = 0; k < 3; ++k) {
+          local(config, 9 + k) = pose.p(k);
+        }
+      }
+    }
+
+    if (compose) {
+      composeBatch(p_out, F * node.parent, local, p_out, out_col);
+    }
+    else {
+      p_out.middleCols(out_col, F) = local;
+    }
+  }
+  return 0;
+}
+
+Frame TreeFkSolverPosFull_flat::getBatchFrame(const BatchArray& p, int config, int segment)
+{
+  Frame frame;
+  for (int k = 0; k < 9; ++k) {
+    frame.M.data[k] = p(config, F * segment + k);
+  }
+  for (int k = 0; k < 3; ++k) {
+    frame.p(k) = p(config, F * segment + 9 + k);
+  }
+  return frame;
+}
+
+}
@@ -0,0 +1,154 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_aggregation.cpp
+// Checks that joint states from several sources are merged into one tf batch
+// per publish interval, that a silent source goes stale, and that no
+// measurement is sent twice.
+
+#include <set>
+#include <string>
+#include <utility>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+#include <tf2_msgs/TFMessage.h>
+
+namespace
+{
+struct TfCounter
+{
+  TfCounter() : batches(0), head(0), arm(0), both(0), repeated_batches(0), repeated_frames(0) {}
+
+  void callback(const tf2_msgs::TFMessageConstPtr& message)
+  {
+    std::set<std::string> frames;
+    ros::Time newest;
+    for (size_t i = 0; i < message->transforms.size(); ++i) {
+      const geometry_msgs::TransformStamped& transform = message->transforms[i];
+      frames.insert(transform.child_frame_id);
+      if (!frame_stamps.insert(std::make_pair(transform.child_frame_id, transform.header.stamp)).second)
+        ++repeated_frames;
+      if (transform.header.stamp > newest)  newest = transform.header.stamp;
+    }
+    if (!batch_stamps.insert(newest).second)
+      ++repeated_batches;
+    bool has_head = frames.count("head_pan_link") && frames.count("head_tilt_link");
+    bool has_arm = frames.count("r_shoulder_pan_link") && frames.count("r_shoulder_lift_link");
+    ++batches;
+    if (has_head)  ++head;
+    if (has_arm)  ++arm;
+    if (has_head && has_arm)  ++both;
+  }
+
+  unsigned int batches, head, arm, both;
+  // a frame sent twice at one stamp makes tf2 report TF_REPEATED_DATA
+  std::set<ros::Time> batch_stamps;
+  std::set<std::pair<std::string, ros::Time> > frame_stamps;
+  unsigned int repeated_batches, repeated_frames;
+};
+
+sensor_msgs::JointState makeState(const std::string& a, const std::string& b)
+{
+  sensor_msgs::JointState js;
+  js.name.push_back(a);
+  js.name.push_back(b);
+  js.position.push_back(0.1);
+  js.position.push_back(0.2);
+  return js;
+}
+}
+
+TEST(TestAggregation, one_batch_per_tick)
+{
+  ros::NodeHandle n;
+  ros::Publisher head_pub = n.advertise<sensor_msgs::JointState>("head_states", 10);
+  ros::Publisher arm_pub = n.advertise<sensor_msgs::JointState>("arm_states", 10);
+  sensor_msgs::JointState head = makeState("head_pan_joint", "head_tilt_joint");
+  sensor_msgs::JointState arm = makeState("r_shoulder_pan_joint", "r_shoulder_lift_joint");
+  ros::Duration(1.0).sleep();
+
+  // both sources for 2 s: the head at 20 Hz, the arm at 100 Hz
+  TfCounter counter;
+  ros::Subscriber tf_sub = n.subscribe("/tf", 100, &TfCounter::callback, &counter);
+  ros::Duration(0.5).sleep();
+  for (unsigned int i = 0; i < 200; ++i) {
+    arm.header.stamp = ros::Time::now();
+    arm_pub.publish(arm);
+    if (i % 5 == 0) {
+      head.header.stamp = arm.header.stamp;
+      head_pub.publish(head);
+    }
+    ros::spinOnce();
+    ros::Duration(0.01).sleep();
+  }
+  ros::spinOnce();
+
+  // publish_frequency is 10 Hz; per-message publishing would send ~240 batches
+  EXPECT_LT(10u, counter.batches);
+  EXPECT_GT(40u, counter.batches);
+  EXPECT_LE(counter.batches - 3, counter.both);
+  EXPECT_EQ(0u, counter.repeated_batches);
+  EXPECT_EQ(0u, counter.repeated_frames);
+
+  // only the arm for 2 s: the head goes stale after its max_age (0.3 s)
+  counter = TfCounter();
+  for (unsigned int i = 0; i < 200; ++i) {
+    arm.header.stamp = ros::Time::now();
+    arm_pub.publish(arm);
+    ros::spinOnce();
+    ros::Duration(0.01).sleep();
+  }
+  ros::spinOnce();
+  EXPECT_LT(10u, counter.arm);
+  EXPECT_GE(5u, counter.head);
+  EXPECT_EQ(0u, counter.repeated_batches);
+  EXPECT_EQ(0u, counter.repeated_frames);
+
+  // no source: nothing new to send, so nothing is re-sent
+  counter = TfCounter();
+  for (unsigned int i = 0; i < 10; ++i) {
+    ros::spinOnce();
+    ros::Duration(0.1).sleep();
+  }
+  ros::spinOnce();
+  EXPECT_GE(1u, counter.batches);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_aggregation");
+  ros::NodeHandle node;
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,269 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_allocations.cpp
+// Checks that steady-state joint state messages are handled without heap
+// allocations, also while publishers with different joint orderings alternate,
+// while the set of joints sent changes, as with a deadband, and when moving
+// transforms go out as shared messages.  Batches are counted rather than sent
+// (see CountingRobotStatePublisher), so what is checked ends where a batch is
+// handed to tf: roscpp's publishing and serialization are not covered.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <urdf/model.h>
+
+#include "test_util.h"
+
+namespace
+{
+// Only allocations made by the test thread are counted; roscpp's own threads keep allocating.
+thread_local bool g_count_allocations = false;
+std::atomic<unsigned int> g_allocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+  if (g_count_allocations)  ++g_allocations;
+  void* p = std::malloc(size ? size : 1);
+  if (!p)  throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+TEST(TestAllocations, steady_state_joint_states)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initParam("robot_base_description"));
+
+  boost::shared_ptr<robot_state_publisher_test::CountingRobotStatePublisher> state_pub(
+    new robot_state_publisher_test::CountingRobotStatePublisher());
+  robot_state_publisher_test::AccessibleJointStateListener listener(state_pub);
+  ASSERT_TRUE(listener.init());
+
+  sensor_msgs::JointState::Ptr js_msg = robot_state_publisher_test::makeJointState(model, 0.1);
+  ASSERT_FALSE(js_msg->name.empty());
+  JointStateConstPtr state(js_msg);
+
+  // Warm up: the first messages resolve the joint indices and size the buffers.
+  ros::Time start = ros::Time::now();
+  const unsigned int warmup = 3;
+  for (unsigned int i = 0; i < warmup; ++i) {
+    js_msg->header.stamp = start + ros::Duration(i);
+    listener.callback(state);
+  }
+  ASSERT_EQ(warmup, state_pub->batches_);
+  EXPECT_LT(js_msg->name.size(), state_pub->transforms_);  // mimic joints are published as well
+
+  const unsigned int messages = 100;
+  g_allocations = 0;
+  for (unsigned int i = warmup; i < warmup + messages; ++i) {
+    js_msg->header.stamp = start + ros::Duration(i);
+    g_count_allocations = true;
+    listener.callback(state);
+    g_count_allocations = false;
+  }
+  EXPECT_EQ(warmup + messages, state_pub->batches_);
+  EXPECT_EQ(0u, g_allocations.load());
+}
+
+TEST(TestAllocations, alternating_joint_orderings)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initParam("robot_base_description"));
+
+  boost::shared_ptr<robot_state_publisher_test::CountingRobotStatePublisher> state_pub(
+    new robot_state_publisher_test::CountingRobotStatePublisher());
+  robot_state_publisher_test::AccessibleJointStateListener listener(state_pub);
+  ASSERT_TRUE(listener.init());
+
+  // two publishers of the same joints, in opposite orders
+  sensor_msgs::JointState::Ptr forward = robot_state_publisher_test::makeJointState(model, 0.1);
+  sensor_msgs::JointState::Ptr reverse(new sensor_msgs::JointState(*forward));
+  std::reverse(reverse->name.begin(), reverse->name.end());
+  ASSERT_LT(1u, forward->name.size());
+  JointStateConstPtr states[] = { forward, reverse };
+
+  ros::Time start = ros::Time::now();
+  const unsigned int warmup = 4;
+  for (unsigned int i = 0; i < warmup; ++i) {
+    forward->header.stamp = reverse->header.stamp = start + ros::Duration(i);
+    listener.callback(states[i % 2]);
+  }
+  ASSERT_EQ(warmup, state_pub->batches_);
+
+  // each ordering stays resolved while the other one is received
+  const unsigned int messages = 100;
+  g_allocations = 0;
+  for (unsigned int i = warmup; i < warmup + messages; ++i) {
+    forward->header.stamp = reverse->header.stamp = start + ros::Duration(i);
+    g_count_allocations = true;
+    listener.callback(states[i % 2]);
+    g_count_allocations = false;
+  }
+  EXPECT_EQ(warmup + messages, state_pub->batches_);
+  EXPECT_EQ(0u, g_allocations.load());
+}
+
+TEST(TestAllocations, alternating_joint_orderings_share_publish_times)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initParam("robot_base_description"));
+
+  boost::shared_ptr<robot_state_publisher_test::CountingRobotStatePublisher> state_pub(
+    new robot_state_publisher_test::CountingRobotStatePublisher());
+  robot_state_publisher_test::AccessibleJointStateListener listener(state_pub);
+  ASSERT_TRUE(listener.init());
+
+  sensor_msgs::JointState::Ptr forward = robot_state_publisher_test::makeJointState(model, 0.1);
+  sensor_msgs::JointState::Ptr reverse(new sensor_msgs::JointState(*forward));
+  std::reverse(reverse->name.begin(), reverse->name.end());
+
+  // stamps in the past are throttled to the publish interval (50 Hz), over both orderings
+  ros::Time start = ros::Time::now() - ros::Duration(10.0);
+  forward->header.stamp = start;
+  listener.callback(forward);
+  EXPECT_EQ(1u, state_pub->batches_);
+  reverse->header.stamp = start + ros::Duration(0.001);
+  listener.callback(reverse);
+  EXPECT_EQ(1u, state_pub->batches_);
+
+  forward->header.stamp = start + ros::Duration(0.05);
+  listener.callback(forward);
+  EXPECT_EQ(2u, state_pub->batches_);
+  // the cached reverse ordering sees that its joints were just published
+  reverse->header.stamp = start + ros::Duration(0.051);
+  listener.callback(reverse);
+  EXPECT_EQ(2u, state_pub->batches_);
+  reverse->header.stamp = start + ros::Duration(0.08);
+  listener.callback(reverse);
+  EXPECT_EQ(3u, state_pub->batches_);
+}
+
+TEST(TestAllocations, changing_joint_sets)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::CountingRobotStatePublisher publisher;
+  ASSERT_TRUE(publisher.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+  const size_t joints = snapshot->joint_segments.size();
+  ASSERT_LT(2u, joints);
+
+  // every joint, every other joint, and a single one take turns
+  std::vector<double> positions(joints, 0.1);
+  std::vector<char> valid[3];
+  valid[0].assign(joints, 1);
+  valid[1].assign(joints, 0);
+  valid[2].assign(joints, 0);
+  for (size_t i = 0; i < joints; i += 2) {
+    valid[1][i] = 1;
+  }
+  valid[2][joints / 2] = 1;
+  ros::Time start(1.0);
+  for (unsigned int i = 0; i < 3; ++i) {
+    publisher.publishTransforms(*snapshot, positions, valid[i], start + ros::Duration(i));
+  }
+
+  const unsigned int messages = 99;
+  g_allocations = 0;
+  for (unsigned int i = 0; i < messages; ++i) {
+    g_count_allocations = true;
+    publisher.publishTransforms(*snapshot, positions, valid[i % 3], start + ros::Duration(3 + i));
+    g_count_allocations = false;
+  }
+  EXPECT_EQ(3u + messages, publisher.batches_);
+  EXPECT_EQ(1u, publisher.transforms_);
+  EXPECT_EQ(0u, g_allocations.load());
+}
+
+TEST(TestAllocations, shared_messages_built_in_place)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::CountingRobotStatePublisher publisher;
+  publisher.setPublishSharedMessages(true);
+  ASSERT_TRUE(publisher.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+  const size_t joints = snapshot->joint_segments.size();
+  std::vector<double> positions(joints, 0.1);
+  std::vector<char> all(joints, 1), one(joints, 0);
+  one[0] = 1;
+
+  // a message held by a subscriber is left alone
+  publisher.capture_ = true;
+  publisher.publishTransforms(*snapshot, positions, all, ros::Time(1.0));
+  tf2_msgs::TFMessageConstPtr held = publisher.last_shared_;
+  ASSERT_TRUE(held);
+  publisher.publishTransforms(*snapshot, positions, one, ros::Time(2.0));
+  EXPECT_NE(held, publisher.last_shared_);
+  EXPECT_EQ(joints, held->transforms.size());
+  EXPECT_EQ(ros::Time(1.0), held->transforms[0].header.stamp);
+  EXPECT_EQ(1u, publisher.last_shared_->transforms.size());
+
+  // once released, it is reused
+  const tf2_msgs::TFMessage* released = held.get();
+  held.reset();
+  publisher.last_shared_.reset();
+  publisher.publishTransforms(*snapshot, positions, all, ros::Time(3.0));
+  EXPECT_EQ(released, publisher.last_shared_.get());
+  publisher.last_shared_.reset();
+  publisher.capture_ = false;
+
+  const unsigned int messages = 100;
+  g_allocations = 0;
+  for (unsigned int i = 0; i < messages; ++i) {
+    g_count_allocations = true;
+    publisher.publishTransforms(*snapshot, positions, (i % 2) ? one : all, ros::Time(4.0 + i));
+    g_count_allocations = false;
+  }
+  EXPECT_EQ(3u + messages, publisher.batches_);
+  EXPECT_EQ(0u, g_allocations.load());
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_allocations");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,188 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_fk_solver.cpp
+// Checks that the flattened FK solver matches the recursive one bit for bit.
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <kdl_parser/kdl_parser.hpp>
+
+#include "robot_state_publisher/treefksolverposfull_flat.hpp"
+#include "robot_state_publisher/treefksolverposfull_recursive.hpp"
+
+typedef std::map<std::string, tf2::Stamped<KDL::Frame> > FrameMap;
+
+static void expectIdentical(const FrameMap& expected, const FrameMap& actual)
+{
+  ASSERT_EQ(expected.size(), actual.size());
+  for (FrameMap::const_iterator e = expected.begin(); e != expected.end(); ++e) {
+    FrameMap::const_iterator a = actual.find(e->first);
+    ASSERT_TRUE(a != actual.end()) << e->first;
+    EXPECT_EQ(e->second.frame_id_, a->second.frame_id_) << e->first;
+    for (int i = 0; i < 9; ++i) {
+      EXPECT_EQ(e->second.M.data[i], a->second.M.data[i]) << e->first;
+    }
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(e->second.p.data[i], a->second.p.data[i]) << e->first;
+    }
+  }
+}
+
+class TestFkSolver : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    std::string urdf;
+    ASSERT_TRUE(ros::param::get("robot_description", urdf));
+    ASSERT_TRUE(kdl_parser::treeFromString(urdf, tree_));
+    ASSERT_LT(1u, tree_.getNrOfJoints());
+  }
+
+  // Random positions for every moving joint of the tree
+  std::map<std::string, double> randomPositions(const KDL::TreeFkSolverPosFull_flat& solver)
+  {
+    std::map<std::string, double> q;
+    for (size_t i = 0; i < solver.getJointNames().size(); ++i) {
+      q[solver.getJointNames()[i]] = 6.0 * std::rand() / RAND_MAX - 3.0;
+    }
+    return q;
+  }
+
+  KDL::Tree tree_;
+};
+
+TEST_F(TestFkSolver, topological_order)
+{
+  KDL::TreeFkSolverPosFull_flat flat(tree_);
+  ASSERT_EQ(tree_.getNrOfSegments() + 1, flat.getNrOfSegments());  // KDL does not count the root
+  EXPECT_EQ(tree_.getNrOfJoints(), flat.getNrOfJoints());
+  EXPECT_EQ(-1, flat.getSegmentParents()[0]);
+  for (unsigned int i = 1; i < flat.getNrOfSegments(); ++i) {
+    EXPECT_LE(0, flat.getSegmentParents()[i]);
+    EXPECT_LT(flat.getSegmentParents()[i], static_cast<int>(i));
+  }
+}
+
+TEST_F(TestFkSolver, matches_recursive_solver)
+{
+  KDL::TreeFkSolverPosFull_recursive recursive(tree_);
+  KDL::TreeFkSolverPosFull_flat flat(tree_);
+
+  std::srand(42);
+  for (int trial = 0; trial < 20; ++trial) {
+    std::map<std::string, double> q = randomPositions(flat);
+    for (int flatten = 0; flatten < 2; ++flatten) {
+      FrameMap expected, actual;
+      recursive.JntToCart(q, expected, flatten);
+      flat.JntToCart(q, actual, flatten);
+      expectIdentical(expected, actual);
+    }
+  }
+}
+
+TEST_F(TestFkSolver, missing_joints_skip_branch)
+{
+  KDL::TreeFkSolverPosFull_recursive recursive(tree_);
+  KDL::TreeFkSolverPosFull_flat flat(tree_);
+
+  std::srand(7);
+  std::map<std::string, double> q = randomPositions(flat);
+  // drop every third joint
+  int n = 0;
+  for (std::map<std::string, double>::iterator i = q.begin(); i != q.end(); ) {
+    if (n++ % 3 == 0) {
+      q.erase(i++);
+    }
+    else {
+      ++i;
+    }
+  }
+
+  FrameMap expected, actual;
+  recursive.JntToCart(q, expected);
+  flat.JntToCart(q, actual);
+  EXPECT_LT(expected.size(), flat.getNrOfSegments() - 1);
+  expectIdentical(expected, actual);
+}
+
+TEST_F(TestFkSolver, batch_matches_single_configurations)
+{
+  KDL::TreeFkSolverPosFull_flat flat(tree_);
+  const int configs = 33;  // not a multiple of any SIMD width
+
+  std::srand(3);
+  KDL::TreeFkSolverPosFull_flat::BatchArray q(configs, flat.getNrOfJoints());
+  for (int c = 0; c < configs; ++c) {
+    for (unsigned int j = 0; j < flat.getNrOfJoints(); ++j) {
+      q(c, j) = 6.0 * std::rand() / RAND_MAX - 3.0;
+    }
+  }
+
+  for (int flatten = 0; flatten < 2; ++flatten) {
+    KDL::TreeFkSolverPosFull_flat::BatchArray p;
+    ASSERT_EQ(0, flat.JntToCartBatch(q, p, flatten));
+    ASSERT_EQ(configs, p.rows());
+
+    std::vector<double> q_single(flat.getNrOfJoints());
+    std::vector<char> q_valid(flat.getNrOfJoints(), 1);
+    std::vector<KDL::Frame> p_single;
+    std::vector<char> p_valid;
+    for (int c = 0; c < configs; ++c) {
+      for (unsigned int j = 0; j < flat.getNrOfJoints(); ++j) {
+        q_single[j] = q(c, j);
+      }
+      ASSERT_EQ(0, flat.JntToCart(q_single, q_valid, p_single, p_valid, flatten));
+      for (unsigned int i = 0; i < flat.getNrOfSegments(); ++i) {
+        EXPECT_TRUE(KDL::Equal(p_single[i], KDL::TreeFkSolverPosFull_flat::getBatchFrame(p, c, i), 1e-9))
+          << flat.getSegmentNames()[i] << " in configuration " << c;
+      }
+    }
+  }
+
+  // every joint needs a position
+  KDL::TreeFkSolverPosFull_flat::BatchArray p;
+  EXPECT_GT(0, flat.JntToCartBatch(q.leftCols(1), p));
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_fk_solver");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,153 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_frame_ids.cpp
+// Checks the interned frame ids of a snapshot, that reused messages keep their
+// labels in step with the joints they carry, and publishing under another prefix.
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "test_util.h"
+
+TEST(TestFrameIds, interned_once_per_link)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher::RobotStatePublisher publisher;
+  publisher.setTfPrefix("robot_2");
+  ASSERT_TRUE(publisher.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+
+  ASSERT_FALSE(snapshot->frame_ids.empty());
+  for (std::map<std::string, std::string>::const_iterator id = snapshot->frame_ids.begin();
+       id != snapshot->frame_ids.end(); ++id) {
+    EXPECT_EQ("robot_2/" + id->first, id->second);
+  }
+  for (size_t i = 0; i < snapshot->joint_segments.size(); ++i) {
+    EXPECT_EQ(snapshot->frame_ids.find(snapshot->joint_segments[i].root)->second,
+              snapshot->joint_transforms[i].header.frame_id);
+    EXPECT_EQ(snapshot->frame_ids.find(snapshot->joint_segments[i].tip)->second,
+              snapshot->joint_transforms[i].child_frame_id);
+  }
+}
+
+TEST(TestFrameIds, reused_message_follows_joints)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::CountingRobotStatePublisher publisher;
+  publisher.capture_ = true;
+  ASSERT_TRUE(publisher.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+  const size_t joints = snapshot->joint_segments.size();
+  ASSERT_LT(2u, joints);
+
+  std::vector<double> positions(joints, 0.1);
+  std::vector<char> valid(joints, 1);
+  for (int round = 0; round < 2; ++round) {
+    // every other joint, then all of them, then every other joint again
+    for (int pass = 0; pass < 3; ++pass) {
+      for (size_t i = 0; i < joints; ++i) {
+        valid[i] = pass == 1 || i % 2 == 0;
+      }
+      publisher.publishTransforms(*snapshot, positions, valid, ros::Time(1.0 + pass));
+      size_t n = 0;
+      for (size_t i = 0; i < joints; ++i) {
+        if (!valid[i])  continue;
+        ASSERT_LT(n, publisher.last_.transforms.size());
+        EXPECT_EQ(snapshot->joint_transforms[i].header.frame_id, publisher.last_.transforms[n].header.frame_id);
+        EXPECT_EQ(snapshot->joint_transforms[i].child_frame_id, publisher.last_.transforms[n].child_frame_id);
+        EXPECT_EQ(ros::Time(1.0 + pass), publisher.last_.transforms[n].header.stamp);
+        ++n;
+      }
+      EXPECT_EQ(n, publisher.last_.transforms.size());
+    }
+  }
+}
+
+TEST(TestFrameIds, fixed_transforms_under_another_prefix)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::CountingRobotStatePublisher publisher;
+  publisher.capture_ = true;
+  ASSERT_TRUE(publisher.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+  ASSERT_FALSE(snapshot->fixed_transforms.empty());
+
+  std::set<std::string> expected;
+  for (size_t i = 0; i < snapshot->fixed_transforms.size(); ++i) {
+    expected.insert("mirror/" + snapshot->fixed_transforms[i].header.frame_id + " mirror/" +
+                    snapshot->fixed_transforms[i].child_frame_id);
+  }
+
+  const char* prefixes[] = { "/mirror/", "mirror" };
+  for (size_t p = 0; p < 2; ++p) {
+    publisher.publishFixedTransforms(std::string(prefixes[p]));
+    std::set<std::string> actual;
+    for (size_t i = 0; i < publisher.last_.transforms.size(); ++i) {
+      actual.insert(publisher.last_.transforms[i].header.frame_id + " " + publisher.last_.transforms[i].child_frame_id);
+    }
+    EXPECT_EQ(expected, actual);
+  }
+
+  // the poses are those of the unprefixed transforms
+  ASSERT_EQ(snapshot->fixed_transforms.size(), publisher.last_.transforms.size());
+  for (size_t i = 0; i < snapshot->fixed_transforms.size(); ++i) {
+    const geometry_msgs::Transform& prefixed = publisher.last_.transforms[i].transform;
+    const geometry_msgs::Transform& unprefixed = snapshot->fixed_transforms[i].transform;
+    EXPECT_EQ(unprefixed.translation.x, prefixed.translation.x);
+    EXPECT_EQ(unprefixed.translation.y, prefixed.translation.y);
+    EXPECT_EQ(unprefixed.translation.z, prefixed.translation.z);
+    EXPECT_EQ(unprefixed.rotation.x, prefixed.rotation.x);
+    EXPECT_EQ(unprefixed.rotation.y, prefixed.rotation.y);
+    EXPECT_EQ(unprefixed.rotation.z, prefixed.rotation.z);
+    EXPECT_EQ(unprefixed.rotation.w, prefixed.rotation.w);
+  }
+
+  // a different prefix relabels the transforms
+  publisher.publishFixedTransforms(std::string("other"));
+  ASSERT_FALSE(publisher.last_.transforms.empty());
+  EXPECT_EQ(0u, publisher.last_.transforms[0].child_frame_id.find("other/"));
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_frame_ids");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
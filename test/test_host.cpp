@@ -0,0 +1,104 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_host.cpp
+// Checks that a subscriber joining /tf_static after robot_state_publisher_host
+// started gets the fixed frames of every robot it serves, not only the last.
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <tf2_msgs/TFMessage.h>
+
+namespace
+{
+bool advertised(const std::string& topic)
+{
+  ros::master::V_TopicInfo topics;
+  if (!ros::master::getTopics(topics))
+    return false;
+  for (size_t i = 0; i < topics.size(); ++i) {
+    if (topics[i].name == topic)
+      return true;
+  }
+  return false;
+}
+
+struct LatchedFrames
+{
+  LatchedFrames() : received(false) {}
+
+  // only the first message, which is the latched one for a late subscriber
+  void callback(const tf2_msgs::TFMessageConstPtr& message)
+  {
+    if (received)
+      return;
+    for (size_t i = 0; i < message->transforms.size(); ++i) {
+      child_frames.insert(message->transforms[i].child_frame_id);
+    }
+    received = true;
+  }
+
+  bool received;
+  std::set<std::string> child_frames;
+};
+}
+
+TEST(TestHost, late_subscriber_gets_every_robot)
+{
+  for (unsigned int i = 0; i < 100 && !advertised("/tf_static"); i++) {
+    ros::Duration(0.1).sleep();
+  }
+  ASSERT_TRUE(advertised("/tf_static"));
+
+  // give every robot time to send its fixed transforms before subscribing
+  ros::Duration(2.0).sleep();
+
+  LatchedFrames frames;
+  ros::NodeHandle n;
+  ros::Subscriber sub = n.subscribe("/tf_static", 10, &LatchedFrames::callback, &frames);
+  for (unsigned int i = 0; i < 100 && !frames.received; i++) {
+    ros::Duration(0.1).sleep();
+    ros::spinOnce();
+  }
+  ASSERT_TRUE(frames.received);
+
+  EXPECT_EQ(1u, frames.child_frames.count("robot_1/link2"));
+  EXPECT_EQ(1u, frames.child_frames.count("robot_2/link2"));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_host");
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_ingest_ring.cpp
+// Checks that a burst of joint states is fully processed through the ingest
+// ring while the listener is busy, and that latest-only ingest keeps the newest.
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+#include "robot_state_publisher/joint_state_listener.h"
+#include "robot_state_publisher/robot_state_publisher.h"
+
+namespace robot_state_publisher_test
+{
+// Counts the messages drained from the ring, taking the given time for each.
+class SlowJointStateListener : public robot_state_publisher::JointStateListener
+{
+public:
+  SlowJointStateListener(double seconds_per_message) :
+    robot_state_publisher::JointStateListener(robot_state_publisher::RobotStatePublisherPtr(
+      new robot_state_publisher::RobotStatePublisher())),
+    processed_(0), last_position_(-1.0), delay_(seconds_per_message)
+  {
+  }
+
+  std::atomic<unsigned int> processed_;
+  std::atomic<double> last_position_;
+
+protected:
+  virtual void callbackJointState(const JointStateConstPtr& state)
+  {
+    delay_.sleep();
+    last_position_ = state->position[0];
+    ++processed_;
+  }
+
+private:
+  ros::WallDuration delay_;
+};
+
+void publishBurst(unsigned int count)
+{
+  ros::NodeHandle n;
+  ros::Publisher pub = n.advertise<sensor_msgs::JointState>("joint_states", count);
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(5.0);
+  while (pub.getNumSubscribers() == 0 && ros::WallTime::now() < deadline) {
+    ros::WallDuration(0.01).sleep();
+  }
+  ros::WallDuration(0.5).sleep();
+
+  sensor_msgs::JointState js;
+  js.name.push_back("joint1");
+  js.position.push_back(0.0);
+  for (unsigned int i = 0; i < count; ++i) {
+    js.header.stamp = ros::Time::now();
+    js.position[0] = i;
+    pub.publish(js);
+  }
+  ros::WallDuration(0.5).sleep();
+}
+
+void waitFor(const std::atomic<unsigned int>& processed, unsigned int count, double seconds)
+{
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(seconds);
+  while (processed < count && ros::WallTime::now() < deadline) {
+    ros::WallDuration(0.01).sleep();
+  }
+}
+}  // robot_state_publisher_test
+
+TEST(TestIngestRing, processes_every_message)
+{
+  ros::param::set("~ingest_queue_size", 100);
+  ros::param::set("~ingest_mode", "all");
+  robot_state_publisher_test::SlowJointStateListener listener(0.005);
+  ASSERT_TRUE(listener.init());
+
+  robot_state_publisher_test::publishBurst(50);
+  robot_state_publisher_test::waitFor(listener.processed_, 50, 5.0);
+  EXPECT_EQ(50u, listener.processed_);
+  EXPECT_EQ(49.0, listener.last_position_);
+}
+
+TEST(TestIngestRing, latest_only_keeps_newest)
+{
+  ros::param::set("~ingest_queue_size", 100);
+  ros::param::set("~ingest_mode", "latest");
+  robot_state_publisher_test::SlowJointStateListener listener(0.05);
+  ASSERT_TRUE(listener.init());
+
+  robot_state_publisher_test::publishBurst(50);
+  ros::WallDuration(1.0).sleep();
+  EXPECT_LT(0u, listener.processed_);
+  EXPECT_GT(50u, listener.processed_);
+  EXPECT_EQ(49.0, listener.last_position_);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_ingest_ring");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
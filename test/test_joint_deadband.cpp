@@ -0,0 +1,93 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_joint_deadband.cpp
+// Checks that joints moving less than joint_deadband are not re-sent until
+// their keep-alive interval expires.
+
+#include <cmath>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "test_util.h"
+
+TEST(TestJointDeadband, suppresses_unchanged_joints)
+{
+  boost::shared_ptr<robot_state_publisher_test::CountingRobotStatePublisher> state_pub(
+    new robot_state_publisher_test::CountingRobotStatePublisher());
+  robot_state_publisher_test::AccessibleJointStateListener listener(state_pub);
+  ASSERT_TRUE(listener.init());
+
+  sensor_msgs::JointState::Ptr js_msg(new sensor_msgs::JointState);
+  js_msg->name.push_back("joint1");
+  js_msg->position.push_back(0.0);
+  JointStateConstPtr state(js_msg);
+  ros::Time start = ros::Time::now();
+
+  // the first position is always sent
+  js_msg->header.stamp = start;
+  listener.callback(state);
+  EXPECT_EQ(1u, state_pub->batches_);
+  EXPECT_EQ(1u, state_pub->transforms_);
+
+  // within the deadband (0.01)
+  js_msg->header.stamp = start + ros::Duration(1.0);
+  js_msg->position[0] = 0.005;
+  listener.callback(state);
+  EXPECT_EQ(1u, state_pub->batches_);
+
+  // outside the deadband
+  js_msg->header.stamp = start + ros::Duration(2.0);
+  js_msg->position[0] = 0.05;
+  listener.callback(state);
+  EXPECT_EQ(2u, state_pub->batches_);
+
+  // a full turn of a continuous joint is no movement
+  js_msg->header.stamp = start + ros::Duration(3.0);
+  js_msg->position[0] = 0.05 + 2.0 * M_PI;
+  listener.callback(state);
+  EXPECT_EQ(2u, state_pub->batches_);
+
+  // the keep-alive interval (5 s) expires
+  js_msg->header.stamp = start + ros::Duration(7.5);
+  listener.callback(state);
+  EXPECT_EQ(3u, state_pub->batches_);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_joint_deadband");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,220 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_kinematic_cache.cpp
+// Checks that a snapshot loaded from the kinematic cache publishes the same
+// transforms as one built from the URDF, that the model is parsed once it is
+// read, and that stale files are ignored.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "robot_state_publisher/kinematic_cache.h"
+#include "test_util.h"
+
+namespace robot_state_publisher_test
+{
+std::string makeCacheDirectory()
+{
+  char directory[] = "/tmp/test_kinematic_cache_XXXXXX";
+  return mkdtemp(directory) ? std::string(directory) : std::string();
+}
+
+void expectEqualFrames(const KDL::Frame& expected, const KDL::Frame& actual)
+{
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(expected.p(i), actual.p(i), 1e-12);
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_NEAR(expected.M(i, j), actual.M(i, j), 1e-12);
+    }
+  }
+}
+
+void expectEqualSnapshots(const robot_state_publisher::KinematicSnapshot& expected,
+                          const robot_state_publisher::KinematicSnapshot& actual)
+{
+  ASSERT_EQ(expected.joint_segments.size(), actual.joint_segments.size());
+  EXPECT_EQ(expected.joint_index, actual.joint_index);
+  EXPECT_EQ(expected.joint_continuous, actual.joint_continuous);
+  const double positions[] = { -2.5, 0.0, 0.3, 1.7 };
+  for (size_t i = 0; i < expected.joint_segments.size(); ++i) {
+    EXPECT_EQ(expected.joint_segments[i].root, actual.joint_segments[i].root);
+    EXPECT_EQ(expected.joint_segments[i].tip, actual.joint_segments[i].tip);
+    EXPECT_EQ(expected.joint_transforms[i].header.frame_id, actual.joint_transforms[i].header.frame_id);
+    EXPECT_EQ(expected.joint_transforms[i].child_frame_id, actual.joint_transforms[i].child_frame_id);
+    for (size_t j = 0; j < sizeof(positions) / sizeof(positions[0]); ++j) {
+      expectEqualFrames(expected.joint_segments[i].segment.pose(positions[j]),
+                        actual.joint_segments[i].segment.pose(positions[j]));
+    }
+  }
+
+  EXPECT_EQ(expected.segments_fixed.size(), actual.segments_fixed.size());
+  ASSERT_EQ(expected.fixed_transforms.size(), actual.fixed_transforms.size());
+  for (size_t i = 0; i < expected.fixed_transforms.size(); ++i) {
+    EXPECT_EQ(expected.fixed_transforms[i].header.frame_id, actual.fixed_transforms[i].header.frame_id);
+    EXPECT_EQ(expected.fixed_transforms[i].child_frame_id, actual.fixed_transforms[i].child_frame_id);
+    EXPECT_EQ(expected.fixed_transforms[i].transform.translation.x, actual.fixed_transforms[i].transform.translation.x);
+    EXPECT_EQ(expected.fixed_transforms[i].transform.rotation.w, actual.fixed_transforms[i].transform.rotation.w);
+  }
+
+  ASSERT_EQ(expected.mimic.size(), actual.mimic.size());
+  for (robot_state_publisher::MimicMap::const_iterator m = expected.mimic.begin(); m != expected.mimic.end(); ++m) {
+    robot_state_publisher::MimicMap::const_iterator other = actual.mimic.find(m->first);
+    ASSERT_TRUE(other != actual.mimic.end());
+    EXPECT_EQ(m->second->joint_name, other->second->joint_name);
+    EXPECT_EQ(m->second->multiplier, other->second->multiplier);
+    EXPECT_EQ(m->second->offset, other->second->offset);
+  }
+}
+}  // robot_state_publisher_test
+
+TEST(TestKinematicCache, warm_start_matches_cold_start)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  std::string directory = robot_state_publisher_test::makeCacheDirectory();
+  ASSERT_FALSE(directory.empty());
+
+  robot_state_publisher::RobotStatePublisher cold;
+  cold.setKinematicCache(directory);
+  ASSERT_TRUE(cold.initFromString(urdf));
+  uint64_t key = robot_state_publisher::KinematicCache::key(urdf, std::vector<std::string>(), "");
+  std::string file = robot_state_publisher::KinematicCache::file(directory, key);
+  ASSERT_TRUE(std::ifstream(file.c_str()).good());
+
+  robot_state_publisher_test::ConfigurableRobotStatePublisher warm;
+  warm.setKinematicCache(directory);
+  ASSERT_TRUE(warm.initFromString(urdf));
+  robot_state_publisher_test::expectEqualSnapshots(*cold.getSnapshot(), *warm.getSnapshot());
+  // the URDF was not parsed
+  EXPECT_TRUE(warm.backgroundModel()->links_.empty());
+
+  // a URDF change parses the deferred model first
+  warm.configure(robot_state_publisher_test::makeTool("cached_tool_joint", "cached_tool", 1.0));
+  EXPECT_TRUE(warm.getUrdfPtr()->getLink("base_link"));
+  EXPECT_TRUE(warm.getUrdfPtr()->getLink("cached_tool"));
+  EXPECT_EQ(cold.getSnapshot()->fixed_transforms.size() + 1, warm.getSnapshot()->fixed_transforms.size());
+
+  remove(file.c_str());
+  remove(directory.c_str());
+}
+
+TEST(TestKinematicCache, warm_start_parses_model_on_first_use)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  std::string directory = robot_state_publisher_test::makeCacheDirectory();
+  ASSERT_FALSE(directory.empty());
+
+  robot_state_publisher::RobotStatePublisher cold;
+  cold.setKinematicCache(directory);
+  ASSERT_TRUE(cold.initFromString(urdf));
+
+  // reading the tree or the model after a warm start returns the parsed one
+  robot_state_publisher_test::ConfigurableRobotStatePublisher tree_first, model_first;
+  tree_first.setKinematicCache(directory);
+  model_first.setKinematicCache(directory);
+  ASSERT_TRUE(tree_first.initFromString(urdf));
+  ASSERT_TRUE(model_first.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = tree_first.getSnapshot();
+  EXPECT_TRUE(tree_first.backgroundModel()->links_.empty());
+  EXPECT_TRUE(model_first.backgroundModel()->links_.empty());
+
+  EXPECT_EQ(cold.getTree().getNrOfSegments(), tree_first.getTree().getNrOfSegments());
+  EXPECT_EQ(cold.getUrdfPtr()->links_.size(), tree_first.getUrdfPtr()->links_.size());
+  EXPECT_EQ(cold.getUrdfPtr()->links_.size(), model_first.getUrdfPtr()->links_.size());
+  EXPECT_TRUE(model_first.getUrdfPtr()->getLink("base_link"));
+  EXPECT_EQ(cold.getTree().getNrOfSegments(), model_first.getTree().getNrOfSegments());
+
+  // the cached snapshot stays in use
+  EXPECT_EQ(snapshot, tree_first.getSnapshot());
+
+  uint64_t key = robot_state_publisher::KinematicCache::key(urdf, std::vector<std::string>(), "");
+  remove(robot_state_publisher::KinematicCache::file(directory, key).c_str());
+  remove(directory.c_str());
+}
+
+TEST(TestKinematicCache, ignores_stale_files)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  std::string directory = robot_state_publisher_test::makeCacheDirectory();
+  ASSERT_FALSE(directory.empty());
+
+  robot_state_publisher::RobotStatePublisher cold;
+  cold.setKinematicCache(directory);
+  ASSERT_TRUE(cold.initFromString(urdf));
+  uint64_t key = robot_state_publisher::KinematicCache::key(urdf, std::vector<std::string>(), "");
+  std::string file = robot_state_publisher::KinematicCache::file(directory, key);
+  ASSERT_TRUE(robot_state_publisher::KinematicCache::load(file, key));
+
+  // another description, or another tf prefix, has another key
+  EXPECT_FALSE(robot_state_publisher::KinematicCache::load(file, key + 1));
+  EXPECT_NE(key, robot_state_publisher::KinematicCache::key(urdf + " ", std::vector<std::string>(), ""));
+  EXPECT_NE(key, robot_state_publisher::KinematicCache::key(urdf, std::vector<std::string>(), "robot_2"));
+
+  // a truncated file is not loaded
+  std::string contents;
+  {
+    std::ifstream in(file.c_str(), std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size() / 2);
+  }
+  EXPECT_FALSE(robot_state_publisher::KinematicCache::load(file, key));
+
+  // and a publisher falls back to parsing the URDF, and rewrites the file
+  robot_state_publisher::RobotStatePublisher rebuilt;
+  rebuilt.setKinematicCache(directory);
+  ASSERT_TRUE(rebuilt.initFromString(urdf));
+  EXPECT_FALSE(rebuilt.getUrdfPtr()->links_.empty());
+  EXPECT_TRUE(robot_state_publisher::KinematicCache::load(file, key));
+
+  remove(file.c_str());
+  remove(directory.c_str());
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_kinematic_cache");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,144 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_mimic_joints.cpp
+// Checks that mimic joints are resolved through chains, whatever the order of
+// their names, and that received positions take precedence.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "robot_state_publisher/robot_state_publisher.h"
+
+namespace robot_state_publisher_test
+{
+// a_mimic copies b_mimic, which copies c_source; a single pass in name order
+// would evaluate a_mimic before b_mimic is set.
+const char* MIMIC_CHAIN_URDF =
+  "<robot name=\"mimic_chain\">"
+  "  <link name=\"base_link\"/>"
+  "  <link name=\"c_link\"/>"
+  "  <link name=\"b_link\"/>"
+  "  <link name=\"a_link\"/>"
+  "  <joint name=\"c_source\" type=\"continuous\">"
+  "    <parent link=\"base_link\"/><child link=\"c_link\"/><axis xyz=\"0 0 1\"/>"
+  "  </joint>"
+  "  <joint name=\"b_mimic\" type=\"continuous\">"
+  "    <parent link=\"c_link\"/><child link=\"b_link\"/><axis xyz=\"0 0 1\"/>"
+  "    <mimic joint=\"c_source\" multiplier=\"2.0\" offset=\"0.1\"/>"
+  "  </joint>"
+  "  <joint name=\"a_mimic\" type=\"continuous\">"
+  "    <parent link=\"b_link\"/><child link=\"a_link\"/><axis xyz=\"0 1 0\"/>"
+  "    <mimic joint=\"b_mimic\" multiplier=\"-1.0\" offset=\"0.5\"/>"
+  "  </joint>"
+  "</robot>";
+}  // robot_state_publisher_test
+
+TEST(TestMimicJoints, resolves_chains)
+{
+  robot_state_publisher::RobotStatePublisher publisher;
+  ASSERT_TRUE(publisher.initFromString(robot_state_publisher_test::MIMIC_CHAIN_URDF));
+  robot_state_publisher::KinematicSnapshotConstPtr snapshot = publisher.getSnapshot();
+  ASSERT_EQ(2u, snapshot->mimic_joints.size());
+  const int source = snapshot->getJointIndex("c_source");
+  const int b = snapshot->getJointIndex("b_mimic");
+  const int a = snapshot->getJointIndex("a_mimic");
+  ASSERT_LE(0, source);
+  ASSERT_LE(0, b);
+  ASSERT_LE(0, a);
+
+  std::vector<double> positions(snapshot->joint_segments.size(), 0.0);
+  std::vector<char> valid(snapshot->joint_segments.size(), 0);
+  positions[source] = 0.3;
+  valid[source] = 1;
+  snapshot->getJointMimicPositions(positions, valid);
+  EXPECT_TRUE(valid[b]);
+  EXPECT_TRUE(valid[a]);
+  EXPECT_DOUBLE_EQ(0.7, positions[b]);
+  EXPECT_DOUBLE_EQ(-0.2, positions[a]);
+
+  std::map<std::string, double> named;
+  named["c_source"] = 0.3;
+  snapshot->getJointMimicPositions(named);
+  EXPECT_DOUBLE_EQ(0.7, named["b_mimic"]);
+  EXPECT_DOUBLE_EQ(-0.2, named["a_mimic"]);
+
+  // a received position is kept, and the rest of the chain follows it
+  positions.assign(positions.size(), 0.0);
+  valid.assign(valid.size(), 0);
+  positions[source] = 0.3;
+  positions[b] = 1.0;
+  valid[source] = valid[b] = 1;
+  snapshot->getJointMimicPositions(positions, valid);
+  EXPECT_DOUBLE_EQ(1.0, positions[b]);
+  EXPECT_DOUBLE_EQ(-0.5, positions[a]);
+
+  // nothing is mimicked without a source
+  positions.assign(positions.size(), 0.0);
+  valid.assign(valid.size(), 0);
+  snapshot->getJointMimicPositions(positions, valid);
+  EXPECT_FALSE(valid[b]);
+  EXPECT_FALSE(valid[a]);
+}
+
+TEST(TestMimicJoints, drops_cycles)
+{
+  robot_state_publisher::RobotStatePublisher publisher;
+  ASSERT_TRUE(publisher.initFromString(robot_state_publisher_test::MIMIC_CHAIN_URDF));
+  robot_state_publisher::KinematicSnapshot snapshot(*publisher.getSnapshot());
+
+  // make c_source copy a_mimic, closing the chain
+  std::shared_ptr<urdf::JointMimic> cycle(new urdf::JointMimic());
+  cycle->joint_name = "a_mimic";
+  cycle->multiplier = 1.0;
+  cycle->offset = 0.0;
+  snapshot.mimic["c_source"] = cycle;
+  snapshot.compileMimicJoints();
+  EXPECT_TRUE(snapshot.mimic_joints.empty());
+
+  std::vector<double> positions(snapshot.joint_segments.size(), 0.0);
+  std::vector<char> valid(snapshot.joint_segments.size(), 0);
+  valid[snapshot.getJointIndex("b_mimic")] = 1;
+  snapshot.getJointMimicPositions(positions, valid);
+  EXPECT_FALSE(valid[snapshot.getJointIndex("a_mimic")]);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_mimic_joints");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,122 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_model_cache.cpp
+// Checks that a repeated set of URDF fragments swaps in the model built for it
+// before, that cached models are never modified, and that re-sent fragments
+// are not rebuilt.
+
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "test_util.h"
+
+namespace robot_state_publisher_test
+{
+bool hasFrame(const robot_state_publisher::KinematicSnapshotConstPtr& snapshot, const std::string& link)
+{
+  return snapshot->frame_ids.count(link) > 0;
+}
+}  // robot_state_publisher_test
+
+TEST(TestModelCache, repeated_fragments_are_swapped_in)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::ConfigurableRobotStatePublisher publisher;
+  publisher.setModelCacheSize(4);
+  ASSERT_TRUE(publisher.initFromString(urdf));
+
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_a", 1.0));
+  robot_state_publisher::KinematicSnapshotConstPtr tool_a = publisher.getSnapshot();
+  EXPECT_TRUE(robot_state_publisher_test::hasFrame(tool_a, "tool_a"));
+
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_b", 2.0));
+  robot_state_publisher::KinematicSnapshotConstPtr tool_b = publisher.getSnapshot();
+  EXPECT_NE(tool_a, tool_b);
+  EXPECT_TRUE(robot_state_publisher_test::hasFrame(tool_b, "tool_b"));
+  EXPECT_FALSE(robot_state_publisher_test::hasFrame(tool_b, "tool_a"));
+
+  // putting tool A back swaps in everything built for it
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_a", 3.0));
+  EXPECT_EQ(tool_a, publisher.getSnapshot());
+  EXPECT_TRUE(publisher.getUrdfPtr()->getLink("tool_a"));
+  EXPECT_FALSE(publisher.getUrdfPtr()->getLink("tool_b"));
+  EXPECT_TRUE(publisher.getTree().getSegments().count("tool_a"));
+  EXPECT_FALSE(publisher.getTree().getSegments().count("tool_b"));
+
+  // a second fragment is built on a copy; the cached model for tool A is untouched
+  publisher.configure(robot_state_publisher_test::makeTool("camera_joint", "camera", 4.0));
+  EXPECT_TRUE(publisher.getUrdfPtr()->getLink("tool_a"));
+  EXPECT_TRUE(publisher.getUrdfPtr()->getLink("camera"));
+  EXPECT_TRUE(robot_state_publisher_test::hasFrame(publisher.getSnapshot(), "camera"));
+  EXPECT_FALSE(robot_state_publisher_test::hasFrame(tool_a, "camera"));
+
+  publisher.configure(robot_state_publisher_test::makeTool("camera_joint", "", 5.0));
+  EXPECT_EQ(tool_a, publisher.getSnapshot());
+  EXPECT_FALSE(publisher.getUrdfPtr()->getLink("camera"));
+  EXPECT_FALSE(publisher.getTree().getSegments().count("camera"));
+}
+
+TEST(TestModelCache, resent_fragment_is_not_rebuilt)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  robot_state_publisher_test::ConfigurableRobotStatePublisher publisher;
+  publisher.setModelCacheSize(0);
+  ASSERT_TRUE(publisher.initFromString(urdf));
+
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_a", 1.0));
+  robot_state_publisher::KinematicSnapshotConstPtr tool_a = publisher.getSnapshot();
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_a", 2.0));
+  EXPECT_EQ(tool_a, publisher.getSnapshot());
+
+  // without the cache, going back to a tool rebuilds it
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_b", 3.0));
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_a", 4.0));
+  EXPECT_NE(tool_a, publisher.getSnapshot());
+  EXPECT_TRUE(robot_state_publisher_test::hasFrame(publisher.getSnapshot(), "tool_a"));
+  EXPECT_FALSE(robot_state_publisher_test::hasFrame(publisher.getSnapshot(), "tool_b"));
+
+  // an older message is still ignored
+  publisher.configure(robot_state_publisher_test::makeTool("tool_joint", "tool_b", 1.5));
+  EXPECT_TRUE(publisher.getUrdfPtr()->getLink("tool_a"));
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_model_cache");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,168 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_pose_kernel.cpp
+// Checks that the specialized pose kernels, and the transforms they fill,
+// match KDL::Segment::pose() and its conversion through tf2_kdl.
+
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <kdl_parser/kdl_parser.hpp>
+#include <tf2_kdl/tf2_kdl.h>
+
+#include "robot_state_publisher/pose_kernel.h"
+
+using robot_state_publisher::PoseKernel;
+
+static void expectEquivalent(const KDL::Segment& segment, const PoseKernel& kernel, double q)
+{
+  KDL::Frame expected = segment.pose(q);
+  KDL::Frame actual = kernel.pose(segment, q);
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_NEAR(expected.M.data[i], actual.M.data[i], 1e-12) << segment.getName() << " at " << q;
+  }
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(expected.p.data[i], actual.p.data[i], 1e-12) << segment.getName() << " at " << q;
+  }
+}
+
+// Compare with the transform converted from KDL; a quaternion and its negation are the same rotation.
+static void expectEquivalentTransform(const KDL::Segment& segment, const PoseKernel& kernel, double q)
+{
+  geometry_msgs::Transform expected = tf2::kdlToTransform(segment.pose(q)).transform;
+  geometry_msgs::Transform actual;
+  kernel.transform(segment, q, actual);
+  EXPECT_NEAR(expected.translation.x, actual.translation.x, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(expected.translation.y, actual.translation.y, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(expected.translation.z, actual.translation.z, 1e-12) << segment.getName() << " at " << q;
+
+  const double dot = expected.rotation.x * actual.rotation.x + expected.rotation.y * actual.rotation.y +
+                     expected.rotation.z * actual.rotation.z + expected.rotation.w * actual.rotation.w;
+  const double sign = dot < 0 ? -1.0 : 1.0;
+  EXPECT_NEAR(expected.rotation.x, sign * actual.rotation.x, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(expected.rotation.y, sign * actual.rotation.y, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(expected.rotation.z, sign * actual.rotation.z, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(expected.rotation.w, sign * actual.rotation.w, 1e-12) << segment.getName() << " at " << q;
+  EXPECT_NEAR(1.0, actual.rotation.x * actual.rotation.x + actual.rotation.y * actual.rotation.y +
+                   actual.rotation.z * actual.rotation.z + actual.rotation.w * actual.rotation.w, 1e-12);
+}
+
+static void expectEquivalent(const KDL::Segment& segment, const PoseKernel& kernel)
+{
+  for (int i = 0; i < 50; ++i) {
+    const double q = 4.0 * M_PI * std::rand() / RAND_MAX - 2.0 * M_PI;
+    expectEquivalent(segment, kernel, q);
+    expectEquivalentTransform(segment, kernel, q);
+  }
+  expectEquivalent(segment, kernel, 0.0);
+  expectEquivalentTransform(segment, kernel, 0.0);
+}
+
+TEST(TestPoseKernel, matches_kdl_on_pr2)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_description", urdf));
+  KDL::Tree tree;
+  ASSERT_TRUE(kdl_parser::treeFromString(urdf, tree));
+
+  std::srand(42);
+  std::map<PoseKernel::Kind, int> kinds;
+  const KDL::SegmentMap& segments = tree.getSegments();
+  for (KDL::SegmentMap::const_iterator s = segments.begin(); s != segments.end(); ++s) {
+    const KDL::Segment& segment = GetTreeElementSegment(s->second);
+    PoseKernel kernel(segment);
+    ++kinds[kernel.kind()];
+    expectEquivalent(segment, kernel);
+  }
+
+  // the pr2 has fixed, prismatic and revolute joints about the axes of their frames
+  EXPECT_LT(0, kinds[PoseKernel::FIXED]);
+  EXPECT_LT(0, kinds[PoseKernel::TRANSLATION]);
+  EXPECT_LT(0, kinds[PoseKernel::ROTATION_X] + kinds[PoseKernel::ROTATION_Y] + kinds[PoseKernel::ROTATION_Z]);
+  EXPECT_EQ(0, kinds[PoseKernel::GENERIC]);
+}
+
+TEST(TestPoseKernel, selects_kernel_by_joint)
+{
+  std::srand(7);
+  KDL::Frame tip(KDL::Rotation::RPY(0.3, -1.1, 2.0), KDL::Vector(0.1, -0.2, 0.3));
+  KDL::Vector axis(0.48, -0.6, 0.64);
+
+  // revolute about an axis of the tip frame, in either direction
+  const KDL::Vector tip_axes[] = { tip.M.UnitX(), tip.M.UnitY(), tip.M.UnitZ() };
+  for (int j = 0; j < 3; ++j) {
+    for (int sign = -1; sign <= 1; sign += 2) {
+      KDL::Segment segment("aligned", KDL::Joint("j", tip.p, tip_axes[j] * sign, KDL::Joint::RotAxis), tip);
+      PoseKernel kernel(segment);
+      EXPECT_EQ(PoseKernel::ROTATION_X + j, kernel.kind());
+      expectEquivalent(segment, kernel);
+    }
+  }
+
+  // revolute about any other axis
+  KDL::Segment revolute("revolute", KDL::Joint("j", tip.p, axis, KDL::Joint::RotAxis), tip);
+  EXPECT_EQ(PoseKernel::ROTATION, PoseKernel(revolute).kind());
+  expectEquivalent(revolute, PoseKernel(revolute));
+
+  // a tip off the axis of the joint
+  KDL::Segment off_axis("off_axis", KDL::Joint("j", KDL::Vector(1.0, 2.0, 3.0), tip_axes[2], KDL::Joint::RotAxis), tip);
+  EXPECT_EQ(PoseKernel::ROTATION_Z, PoseKernel(off_axis).kind());
+  expectEquivalent(off_axis, PoseKernel(off_axis));
+  KDL::Segment off_axis_generic("off_axis", KDL::Joint("j", KDL::Vector(1.0, 2.0, 3.0), axis, KDL::Joint::RotAxis), tip);
+  EXPECT_EQ(PoseKernel::ROTATION, PoseKernel(off_axis_generic).kind());
+  expectEquivalent(off_axis_generic, PoseKernel(off_axis_generic));
+
+  KDL::Segment prismatic("prismatic", KDL::Joint("j", tip.p, axis, KDL::Joint::TransAxis), tip);
+  EXPECT_EQ(PoseKernel::TRANSLATION, PoseKernel(prismatic).kind());
+  expectEquivalent(prismatic, PoseKernel(prismatic));
+
+  KDL::Segment fixed("fixed", KDL::Joint("j", KDL::Joint::None), tip);
+  EXPECT_EQ(PoseKernel::FIXED, PoseKernel(fixed).kind());
+  expectEquivalent(fixed, PoseKernel(fixed));
+
+  // scale and offset are left to KDL
+  KDL::Segment scaled("scaled", KDL::Joint("j", tip.p, axis, KDL::Joint::RotAxis, 2.0, 0.1), tip);
+  EXPECT_EQ(PoseKernel::GENERIC, PoseKernel(scaled).kind());
+  expectEquivalent(scaled, PoseKernel(scaled));
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_pose_kernel");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
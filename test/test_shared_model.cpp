@@ -0,0 +1,113 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_shared_model.cpp
+// Checks that robots loaded from the same description share one model until
+// one of them receives its own URDFConfiguration.
+
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+#include "robot_state_publisher/shared_model.h"
+#include "test_util.h"
+
+TEST(TestSharedModel, copy_on_write)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+
+  robot_state_publisher_test::ConfigurableRobotStatePublisher first, second;
+  ASSERT_TRUE(first.initFromString(urdf));
+  ASSERT_TRUE(second.initFromString(urdf));
+  EXPECT_EQ(1u, robot_urdf::SharedModel::count());
+  EXPECT_EQ(first.getUrdfPtr().get(), second.getUrdfPtr().get());
+  EXPECT_EQ(first.getUrdfPtr().get(), first.backgroundModel());
+  EXPECT_EQ(&first.getTree(), &second.getTree());
+
+  // the first robot gets a tool; the second keeps the shared model
+  first.configure(robot_state_publisher_test::makeTool("shared_tool_joint", "shared_tool", 1.0));
+  EXPECT_TRUE(first.getUrdfPtr()->getLink("shared_tool"));
+  EXPECT_FALSE(second.getUrdfPtr()->getLink("shared_tool"));
+  EXPECT_NE(first.getUrdfPtr().get(), second.getUrdfPtr().get());
+  EXPECT_NE(first.getUrdfPtr().get(), first.backgroundModel());
+  EXPECT_TRUE(first.getTree().getSegments().count("shared_tool"));
+  EXPECT_FALSE(second.getTree().getSegments().count("shared_tool"));
+  EXPECT_EQ(second.getUrdfPtr().get(), second.backgroundModel());
+  EXPECT_EQ(1u, robot_urdf::SharedModel::count());
+
+  // the background of the first robot caught up with the change as well
+  first.configure(robot_state_publisher_test::makeTool("shared_tool_joint", "shared_tool", 2.0));
+  EXPECT_TRUE(first.getUrdfPtr()->getLink("shared_tool"));
+  EXPECT_FALSE(second.getUrdfPtr()->getLink("shared_tool"));
+}
+
+TEST(TestSharedModel, released_with_last_robot)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+  {
+    robot_state_publisher::RobotStatePublisher robot;
+    ASSERT_TRUE(robot.initFromString(urdf));
+    EXPECT_EQ(1u, robot_urdf::SharedModel::count());
+  }
+  EXPECT_EQ(0u, robot_urdf::SharedModel::count());
+}
+
+TEST(TestSharedModel, tf_prefix)
+{
+  std::string urdf;
+  ASSERT_TRUE(ros::param::get("robot_base_description", urdf));
+
+  robot_state_publisher::RobotStatePublisher plain, prefixed;
+  prefixed.setTfPrefix("/robot_2/");
+  ASSERT_TRUE(plain.initFromString(urdf));
+  ASSERT_TRUE(prefixed.initFromString(urdf));
+  robot_state_publisher::KinematicSnapshotConstPtr plain_snapshot = plain.getSnapshot();
+  robot_state_publisher::KinematicSnapshotConstPtr prefixed_snapshot = prefixed.getSnapshot();
+  ASSERT_EQ(plain_snapshot->joint_transforms.size(), prefixed_snapshot->joint_transforms.size());
+  ASSERT_FALSE(plain_snapshot->joint_transforms.empty());
+  for (size_t i = 0; i < plain_snapshot->joint_transforms.size(); ++i) {
+    EXPECT_EQ("robot_2/" + plain_snapshot->joint_transforms[i].header.frame_id,
+              prefixed_snapshot->joint_transforms[i].header.frame_id);
+    EXPECT_EQ("robot_2/" + plain_snapshot->joint_transforms[i].child_frame_id,
+              prefixed_snapshot->joint_transforms[i].child_frame_id);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_shared_model");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,104 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_urdf_swap_stress.cpp
+// Streams joint states while URDF configurations are swapped in from another
+// thread, and checks that no joint state publication is dropped.
+
+#include <atomic>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <boost/thread/thread.hpp>
+#include <urdf/model.h>
+
+#include "test_util.h"
+
+namespace robot_state_publisher_test
+{
+// Alternately attach and remove a tool on the base until told to stop,
+// counting the configurations applied.
+void swapTools(CountingRobotStatePublisher* state_pub, std::atomic<bool>* done, std::atomic<uint32_t>* swaps)
+{
+  for (unsigned int i = 1; !*done; ++i) {
+    state_pub->configure(makeTool("stress_tool_joint", (i % 2) ? "stress_tool" : "", static_cast<double>(i)));
+    ++*swaps;
+  }
+}
+}  // robot_state_publisher_test
+
+TEST(TestURDFSwapStress, no_dropped_publications)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initParam("robot_base_description"));
+
+  boost::shared_ptr<robot_state_publisher_test::CountingRobotStatePublisher> state_pub(
+    new robot_state_publisher_test::CountingRobotStatePublisher());
+  // every swap rebuilds the model, rather than swapping in a cached one
+  state_pub->setModelCacheSize(0);
+  robot_state_publisher_test::AccessibleJointStateListener listener(state_pub);
+  ASSERT_TRUE(listener.init());
+
+  sensor_msgs::JointState::Ptr js_msg = robot_state_publisher_test::makeJointState(model, 0.1);
+  JointStateConstPtr state(js_msg);
+
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> swaps(0);
+  boost::thread swapper(robot_state_publisher_test::swapTools, state_pub.get(), &done, &swaps);
+
+  // Keep streaming until a good number of swaps happened during the stream.
+  const unsigned int min_messages = 1000;
+  const uint32_t min_swaps = 20;
+  ros::Time start = ros::Time::now();
+  unsigned int messages = 0;
+  while (messages < min_messages || swaps < min_swaps) {
+    js_msg->header.stamp = start + ros::Duration(static_cast<double>(messages));
+    listener.callback(state);
+    ++messages;
+    ASSERT_LT(messages, 10000000u) << "URDF swaps did not happen";
+  }
+  done = true;
+  swapper.join();
+
+  unsigned int dropped = messages - state_pub->batches_;
+  EXPECT_EQ(0u, dropped);
+  // the swapper has stopped, so the publisher's own count may be read
+  EXPECT_LE(min_swaps, state_pub->updateCount());
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "test_urdf_swap_stress");
+  testing::InitGoogleTest(&argc, argv);
+
+  int res = RUN_ALL_TESTS();
+
+  return res;
+}
@@ -0,0 +1,147 @@
+/*********************************************************************
+ # Copyright (c) 2008-2015, Rethink Robotics
+ # All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are met:
+ #
+ # 1. Redistributions of source code must retain the above copyright notice,
+ #    this list of conditions and the following disclaimer.
+ # 2. Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ # 3. Neither the name of the Rethink Robotics nor the names of its
+ #    contributors may be used to endorse or promote products derived from
+ #    this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ # AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ # ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ # LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ # INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ # CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ # POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// test_util.h
+// Scaffolding shared by the tests that drive the publisher and the listener
+// directly, without a joint state publisher or a URDF configuration topic.
+
+#ifndef ROBOT_STATE_PUBLISHER_TEST_UTIL_H_
+#define ROBOT_STATE_PUBLISHER_TEST_UTIL_H_
+
+#include <map>
+#include <string>
+
+#include <ros/ros.h>
+#include <urdf/model.h>
+#include <sensor_msgs/JointState.h>
+#include <intera_core_msgs/URDFConfiguration.h>
+
+#include "robot_state_publisher/joint_state_listener.h"
+#include "robot_state_publisher/robot_state_publisher.h"
+
+namespace robot_state_publisher_test
+{
+// Takes URDF configurations as calls rather than messages.
+class ConfigurableRobotStatePublisher : public robot_state_publisher::RobotStatePublisher
+{
+public:
+  void configure(const intera_core_msgs::URDFConfiguration& config)
+  {
+    onURDFConfigurationMsg(config);
+  }
+
+  const urdf::Model* backgroundModel() { return getUrdfBgPtr().get(); }
+
+  // Not synchronized; read only while no other thread applies configurations.
+  uint32_t updateCount() const { return m_updateCount; }
+};
+
+// Counts the batches of moving transforms instead of sending them, shared or
+// not, so nothing reaches roscpp's publishing and serialization.  Fixed
+// transforms go out from the fixed joint timer thread and are not counted.  With capture_ set, the last batch is also copied into last_, and
+// the last shared one held in last_shared_.
+class CountingRobotStatePublisher : public ConfigurableRobotStatePublisher
+{
+public:
+  CountingRobotStatePublisher() : batches_(0), transforms_(0), capture_(false)
+  {
+  }
+
+  unsigned int batches_;
+  size_t transforms_;
+  bool capture_;
+  tf2_msgs::TFMessage last_;
+  tf2_msgs::TFMessageConstPtr last_shared_;
+
+protected:
+  virtual void sendTransforms(const tf2_msgs::TFMessage& message, bool use_tf_static)
+  {
+    if (use_tf_static)  return;
+    ++batches_;
+    transforms_ = message.transforms.size();
+    if (capture_)  last_ = message;
+  }
+
+  virtual void sendSharedTransforms(const tf2_msgs::TFMessageConstPtr& message)
+  {
+    sendTransforms(*message, false);
+    if (capture_)  last_shared_ = message;
+  }
+};
+
+// Runs the joint state callback on a message directly.
+class AccessibleJointStateListener : public robot_state_publisher::JointStateListener
+{
+public:
+  AccessibleJointStateListener(const robot_state_publisher::RobotStatePublisherPtr& state_publisher) :
+    robot_state_publisher::JointStateListener(state_publisher)
+  {
+  }
+
+  void callback(const JointStateConstPtr& state)
+  {
+    callbackJointState(state);
+  }
+};
+
+// A joint state with every moving joint of the model that does not mimic another, all at one position.
+inline sensor_msgs::JointState::Ptr makeJointState(const urdf::Model& model, double position)
+{
+  sensor_msgs::JointState::Ptr state(new sensor_msgs::JointState);
+  for (std::map<std::string, urdf::JointSharedPtr>::const_iterator i = model.joints_.begin(); i != model.joints_.end(); ++i) {
+    if (i->second->type != urdf::Joint::FIXED && i->second->type != urdf::Joint::FLOATING && !i->second->mimic) {
+      state->name.push_back(i->first);
+      state->position.push_back(position);
+    }
+  }
+  return state;
+}
+
+// A URDF configuration attaching a link to base_link through a fixed joint; an empty link removes the fragment.
+inline intera_core_msgs::URDFConfiguration makeTool(const std::string& joint, const std::string& link, double time)
+{
+  intera_core_msgs::URDFConfiguration config;
+  config.link = "base_link";
+  config.joint = joint;
+  config.time = ros::Time(time);
+  if (!link.empty()) {
+    config.urdf =
+      "<robot name=\"tool\">"
+      "  <link name=\"" + link + "\"/>"
+      "  <joint name=\"" + joint + "\" type=\"fixed\">"
+      "    <parent link=\"base_link\"/>"
+      "    <child link=\"" + link + "\"/>"
+      "  </joint>"
+      "</robot>";
+  }
+  return config;
+}
+}  // robot_state_publisher_test
+
+#endif /* ROBOT_STATE_PUBLISHER_TEST_UTIL_H_ */